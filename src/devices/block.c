@@ -139,6 +139,63 @@ block_write (struct block *block, block_sector_t sector, const void *buffer)
   block->write_cnt++;
 }
 
+/* Reads CNT consecutive sectors starting at SECTOR from BLOCK
+   into BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE
+   bytes.  Drivers that support it transfer all of the sectors
+   with a single command.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_read_multi (struct block *block, block_sector_t sector, size_t cnt,
+                  void *buffer)
+{
+  if (cnt == 0)
+    return;
+
+  check_sector (block, sector);
+  check_sector (block, sector + cnt - 1);
+  if (block->ops->read_multi != NULL)
+    block->ops->read_multi (block->aux, sector, cnt, buffer);
+  else
+    {
+      uint8_t *p = buffer;
+      size_t i;
+
+      for (i = 0; i < cnt; i++, p += BLOCK_SECTOR_SIZE)
+        block->ops->read (block->aux, sector + i, p);
+    }
+  block->read_cnt += cnt;
+}
+
+/* Writes CNT consecutive sectors starting at SECTOR to BLOCK from
+   BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.
+   Returns after the block device has acknowledged receiving all
+   of the data.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_write_multi (struct block *block, block_sector_t sector, size_t cnt,
+                   const void *buffer)
+{
+  if (cnt == 0)
+    return;
+
+  check_sector (block, sector);
+  check_sector (block, sector + cnt - 1);
+  ASSERT (block->type != BLOCK_FOREIGN);
+  if (block->ops->write_multi != NULL)
+    block->ops->write_multi (block->aux, sector, cnt, buffer);
+  else
+    {
+      const uint8_t *p = buffer;
+      size_t i;
+
+      for (i = 0; i < cnt; i++, p += BLOCK_SECTOR_SIZE)
+        block->ops->write (block->aux, sector + i, p);
+    }
+  block->write_cnt += cnt;
+}
+
 /* Returns the number of sectors in BLOCK. */
 block_sector_t
 block_size (struct block *block)
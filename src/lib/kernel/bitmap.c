@@ -326,6 +326,33 @@ bitmap_scan_and_flip (struct bitmap *b, size_t start, size_t cnt, bool value)
   return idx;
 }
 
+/* Finds the first bit in B at or after START that is set to
+   VALUE and returns its index, or BITMAP_ERROR if there is no
+   such bit.
+   Unlike bitmap_scan(), this examines a whole element at a time,
+   so long runs of !VALUE bits are skipped cheaply. */
+size_t
+bitmap_scan_bit (const struct bitmap *b, size_t start, bool value)
+{
+  size_t i;
+
+  ASSERT (b != NULL);
+  ASSERT (start <= b->bit_cnt);
+
+  for (i = elem_idx (start); i < elem_cnt (b->bit_cnt); i++)
+    {
+      elem_type bits = value ? b->bits[i] : ~b->bits[i];
+      if (i == elem_idx (start))
+        bits &= (elem_type) -1 << (start % ELEM_BITS);
+      if (bits != 0)
+        {
+          size_t idx = i * ELEM_BITS + __builtin_ctzl (bits);
+          return idx < b->bit_cnt ? idx : BITMAP_ERROR;
+        }
+    }
+  return BITMAP_ERROR;
+}
+
 /* File input and output. */
 
 #ifdef FILESYS
@@ -22,6 +22,12 @@ enum
     /* Task 3 and optionally task 4. */
     SYS_MMAP,                   /* Map a file into memory. */
     SYS_MUNMAP,                 /* Remove a memory mapping. */
+    SYS_MADVISE,                /* Advise on the use of a memory range. */
+    SYS_MSYNC,                  /* Write back a memory-mapped range. */
+    SYS_MLOCK,                  /* Lock a range in memory. */
+    SYS_MUNLOCK,                /* Unlock a range locked by mlock(). */
+    SYS_SETRSS,                 /* Set the resident-set limit. */
+    SYS_FORK,                   /* Duplicate the current process. */
 
     /* Task 4 only. */
     SYS_CHDIR,                  /* Change the current directory. */
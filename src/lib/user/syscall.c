@@ -153,6 +153,42 @@ munmap (mapid_t mapid)
   syscall1 (SYS_MUNMAP, mapid);
 }
 
+int
+madvise (void *addr, unsigned length, int advice)
+{
+  return syscall3 (SYS_MADVISE, addr, length, advice);
+}
+
+int
+msync (void *addr, unsigned length, int flags)
+{
+  return syscall3 (SYS_MSYNC, addr, length, flags);
+}
+
+int
+mlock (const void *addr, unsigned length)
+{
+  return syscall2 (SYS_MLOCK, addr, length);
+}
+
+int
+munlock (const void *addr, unsigned length)
+{
+  return syscall2 (SYS_MUNLOCK, addr, length);
+}
+
+int
+setrss (unsigned pages)
+{
+  return syscall1 (SYS_SETRSS, pages);
+}
+
+pid_t
+fork (void)
+{
+  return syscall0 (SYS_FORK);
+}
+
 bool
 chdir (const char *dir)
 {
@@ -12,6 +12,21 @@ typedef int pid_t;
 typedef int mapid_t;
 #define MAP_FAILED ((mapid_t) -1)
 
+/* Advice for madvise(). */
+#define MADV_NORMAL 0           /* No particular access pattern. */
+#define MADV_RANDOM 1           /* Random access: do not read ahead. */
+#define MADV_SEQUENTIAL 2       /* Sequential access: read well ahead, and
+                                   let pages go soon after use. */
+#define MADV_WILLNEED 3         /* Will be needed soon: read in now. */
+#define MADV_DONTNEED 4         /* Not needed: drop the pages now. */
+
+/* Flags for msync().  Writes are always done before msync()
+   returns, so MS_ASYNC behaves like MS_SYNC, and mappings always see
+   the file's current contents, so MS_INVALIDATE has nothing to do. */
+#define MS_ASYNC 1              /* Start writing back. */
+#define MS_INVALIDATE 2         /* Invalidate other mappings. */
+#define MS_SYNC 4               /* Write back before returning. */
+
 /* Maximum characters in a filename written by readdir(). */
 #define READDIR_MAX_LEN 14
 
@@ -37,6 +52,12 @@ void close (int fd);
 /* Task 3 and optionally task 4. */
 mapid_t mmap (int fd, void *addr);
 void munmap (mapid_t);
+int madvise (void *addr, unsigned length, int advice);
+int msync (void *addr, unsigned length, int flags);
+int mlock (const void *addr, unsigned length);
+int munlock (const void *addr, unsigned length);
+int setrss (unsigned pages);
+pid_t fork (void);
 
 /* Task 4 only. */
 bool chdir (const char *dir);
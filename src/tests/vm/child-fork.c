@@ -0,0 +1,16 @@
+/* Child process of page-fork-exec.
+   Builds the state of fork-work.c and does the work on it. */
+
+#include "tests/vm/fork-work.h"
+#include "tests/lib.h"
+
+const char *test_name = "child-fork";
+
+static unsigned char buf[FORK_WORK_SIZE];
+
+int
+main (void)
+{
+  fork_work_init (buf);
+  return fork_work (buf);
+}
@@ -0,0 +1,20 @@
+/* Child process of switch-proc.
+   Spins for a while, touching a little memory on the way. */
+
+#include "tests/lib.h"
+
+const char *test_name = "child-spin";
+
+#define SPIN_CNT 20000000
+
+static volatile int counter[1024];
+
+int
+main (void)
+{
+  int i;
+
+  for (i = 0; i < SPIN_CNT; i++)
+    counter[i % 1024]++;
+  return 0x42;
+}
@@ -0,0 +1,46 @@
+/* The work done by each child of page-fork and page-fork-exec: it
+   needs the same 512 kB of state that the parent built, reads all of
+   it and writes some of it.  A forked child inherits the state, while
+   an exec'd child has to build it again, which is what the two tests
+   compare. */
+
+#include "tests/vm/fork-work.h"
+#include "tests/arc4.h"
+
+#define PAGE (4 * 1024)
+#define WRITE_CNT 8                     /* Pages written by the work. */
+
+/* Fills BUF with the state, which takes a while. */
+void
+fork_work_init (unsigned char *buf)
+{
+  struct arc4 arc4;
+
+  arc4_init (&arc4, "fork-work", 9);
+  arc4_crypt (&arc4, buf, FORK_WORK_SIZE);
+}
+
+/* Returns the sum of the bytes of BUF. */
+int
+fork_work_sum (const unsigned char *buf)
+{
+  int sum = 0;
+  size_t i;
+
+  for (i = 0; i < FORK_WORK_SIZE; i++)
+    sum += buf[i];
+  return sum;
+}
+
+/* Reads all of BUF, then writes to a few of its pages.  Returns the
+   sum of the bytes of BUF as it was. */
+int
+fork_work (unsigned char *buf)
+{
+  int sum = fork_work_sum (buf);
+  size_t i;
+
+  for (i = 0; i < WRITE_CNT; i++)
+    buf[i * (FORK_WORK_SIZE / WRITE_CNT)]++;
+  return sum;
+}
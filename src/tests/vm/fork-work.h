@@ -0,0 +1,11 @@
+#ifndef TESTS_VM_FORK_WORK
+#define TESTS_VM_FORK_WORK 1
+
+#define FORK_WORK_SIZE (512 * 1024)     /* Bytes of state. */
+#define FORK_WORK_ROUNDS 8              /* Children to run. */
+
+void fork_work_init (unsigned char *buf);
+int fork_work_sum (const unsigned char *buf);
+int fork_work (unsigned char *buf);
+
+#endif /* tests/vm/fork-work.h */
@@ -0,0 +1,31 @@
+/* Checks the arguments and limits of mlock() and munlock(): ranges
+   must be page-aligned and mapped, and one process may lock no more
+   than 64 pages at a time. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE (4 * 1024)
+#define LOCK_MAX 64
+
+static char buf[(LOCK_MAX + 2) * PAGE];
+
+void
+test_main (void)
+{
+  char *start = (char *) (((unsigned) buf + PAGE - 1) & ~(PAGE - 1));
+
+  CHECK (mlock (start + 1, PAGE) == -1, "reject misaligned address");
+  CHECK (mlock ((void *) 0x10000000, PAGE) == -1, "reject unmapped range");
+  CHECK (mlock (start, (LOCK_MAX + 1) * PAGE) == -1,
+         "reject %d pages", LOCK_MAX + 1);
+  CHECK (mlock (start, LOCK_MAX * PAGE) == 0, "mlock %d pages", LOCK_MAX);
+  CHECK (mlock (start, PAGE) == 0, "mlock a locked page again");
+  CHECK (mlock (start + LOCK_MAX * PAGE, PAGE) == -1,
+         "reject one page over the limit");
+  CHECK (munlock (start, PAGE) == 0, "munlock one page");
+  CHECK (mlock (start + LOCK_MAX * PAGE, PAGE) == 0,
+         "mlock one page after munlock");
+  CHECK (munlock (start, (LOCK_MAX + 1) * PAGE) == 0, "munlock all");
+}
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mlock-limit) begin
+(mlock-limit) reject misaligned address
+(mlock-limit) reject unmapped range
+(mlock-limit) reject 65 pages
+(mlock-limit) mlock 64 pages
+(mlock-limit) mlock a locked page again
+(mlock-limit) reject one page over the limit
+(mlock-limit) munlock one page
+(mlock-limit) mlock one page after munlock
+(mlock-limit) munlock all
+(mlock-limit) end
+EOF
+pass;
@@ -0,0 +1,48 @@
+/* Locks part of a buffer in memory with mlock(), then sweeps a much
+   larger buffer through a small user pool, so that most frames are
+   evicted many times over, and checks that the locked pages kept
+   their contents throughout.  Pages read back from swap would keep
+   their contents too, so the .ck file also checks the kernel's count
+   of evictions of locked pages, which must be 0. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/arc4.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE (4 * 1024)
+#define LOCKED_PAGES 32
+#define SWEEP_SIZE (1024 * 1024)
+#define SWEEP_CNT 3
+
+static char locked[(LOCKED_PAGES + 1) * PAGE];
+static char sweep[SWEEP_SIZE];
+
+void
+test_main (void)
+{
+  char *start = (char *) (((unsigned) locked + PAGE - 1) & ~(PAGE - 1));
+  struct arc4 arc4;
+  size_t i;
+  int pass;
+
+  CHECK (mlock (start, LOCKED_PAGES * PAGE) == 0, "mlock %d pages",
+         LOCKED_PAGES);
+  for (i = 0; i < LOCKED_PAGES; i++)
+    memset (start + i * PAGE, i + 1, PAGE);
+
+  for (pass = 0; pass < SWEEP_CNT; pass++)
+    {
+      arc4_init (&arc4, "foobar", 6);
+      arc4_crypt (&arc4, sweep, SWEEP_SIZE);
+
+      for (i = 0; i < LOCKED_PAGES * PAGE; i++)
+        if (start[i] != (char) (i / PAGE + 1))
+          fail ("byte %zu of locked pages is %d after sweep %d",
+                i, start[i], pass);
+      msg ("sweep %d", pass);
+    }
+
+  CHECK (munlock (start, LOCKED_PAGES * PAGE) == 0, "munlock");
+}
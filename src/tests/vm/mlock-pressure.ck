@@ -0,0 +1,29 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mlock-pressure) begin
+(mlock-pressure) mlock 32 pages
+(mlock-pressure) sweep 0
+(mlock-pressure) sweep 1
+(mlock-pressure) sweep 2
+(mlock-pressure) munlock
+(mlock-pressure) end
+EOF
+
+# Locked pages come back from swap intact, so their contents cannot
+# show that they stayed resident.  The kernel counts every eviction
+# that picks a frame of a locked page instead.
+our ($test);
+my ($evictions, $locked_evictions);
+foreach (read_text_file ("$test.output")) {
+    $evictions = $1 if /^Frames: (\d+) evictions \(/;
+    $locked_evictions = $1 if /^Frames: (\d+) evictions of locked pages$/;
+}
+fail "no frame statistics in output\n"
+  if !defined $evictions || !defined $locked_evictions;
+fail "no frames were evicted, so nothing was tested\n" if $evictions == 0;
+fail "$locked_evictions frames of locked pages were evicted\n"
+  if $locked_evictions != 0;
+pass;
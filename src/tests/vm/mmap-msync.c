@@ -0,0 +1,44 @@
+/* Writes to a file through a mapping and syncs it with msync(),
+   then, with the file still mapped, reads the data in the file back
+   using the read system call to verify.  Writes once more after the
+   sync, to check that the page is still mapped and writable. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((void *) 0x10000000)
+
+void
+test_main (void)
+{
+  int handle;
+  mapid_t map;
+  char buf[1024];
+
+  /* Write file via mmap. */
+  CHECK (create ("sample.txt", strlen (sample)), "create \"sample.txt\"");
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map = mmap (handle, ACTUAL)) != MAP_FAILED, "mmap \"sample.txt\"");
+  memcpy (ACTUAL, sample, strlen (sample));
+  CHECK (msync (ACTUAL, strlen (sample), MS_SYNC) == 0, "msync \"sample.txt\"");
+
+  /* Read back via read(), while still mapped. */
+  read (handle, buf, strlen (sample));
+  CHECK (!memcmp (buf, sample, strlen (sample)),
+         "compare read data against written data");
+
+  /* Write again, and check the second write reaches the file too. */
+  memset (ACTUAL, '#', 8);
+  CHECK (msync (ACTUAL, 8, MS_ASYNC | MS_INVALIDATE) == 0,
+         "msync \"sample.txt\" again");
+  seek (handle, 0);
+  read (handle, buf, 8);
+  CHECK (!memcmp (buf, "########", 8), "compare second write");
+
+  CHECK (msync (ACTUAL, 8, MS_ASYNC | MS_SYNC) == -1, "reject bad flags");
+  munmap (map);
+  close (handle);
+}
@@ -0,0 +1,48 @@
+/* Writes a 128 kB file with write(), maps it, and reads it back
+   through the mapping, first front to back and then page by page
+   from the end, checking that every byte matches. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/cksum.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (128 * 1024)
+#define PAGE (4 * 1024)
+
+static char *buf = (char *) 0x10000000;
+static char page[PAGE];
+
+void
+test_main (void)
+{
+  size_t i, j;
+  mapid_t map;
+  int handle;
+
+  /* Create and fill the file. */
+  CHECK (create ("buffer", SIZE), "create \"buffer\"");
+  CHECK ((handle = open ("buffer")) > 1, "open \"buffer\"");
+  for (i = 0; i < SIZE; i += PAGE)
+    {
+      for (j = 0; j < PAGE; j++)
+        page[j] = (i + j) * 257;
+      if (write (handle, page, PAGE) != PAGE)
+        fail ("write \"buffer\" failed at offset %zu", i);
+    }
+  CHECK ((map = mmap (handle, buf)) != MAP_FAILED, "mmap \"buffer\"");
+
+  /* Read sequentially. */
+  msg ("read: cksum=%lu", cksum (buf, SIZE));
+
+  /* Verify page by page, last page first. */
+  for (i = SIZE; i > 0; i -= PAGE)
+    for (j = i - PAGE; j < i; j++)
+      if (buf[j] != (char) (j * 257))
+        fail ("byte %zu of \"buffer\" differs", j);
+  msg ("verified in reverse");
+
+  munmap (map);
+  close (handle);
+}
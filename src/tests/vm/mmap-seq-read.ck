@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-seq-read) begin
+(mmap-seq-read) create "buffer"
+(mmap-seq-read) open "buffer"
+(mmap-seq-read) mmap "buffer"
+(mmap-seq-read) read: cksum=3115322833
+(mmap-seq-read) verified in reverse
+(mmap-seq-read) end
+EOF
+pass;
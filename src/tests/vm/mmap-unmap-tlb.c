@@ -0,0 +1,32 @@
+/* Maps a file of more pages than a page table batch invalidates one
+   by one, reads every page so that the CPU caches its translation,
+   and unmaps it.  Verifies that the last page is inaccessible
+   afterward, that is, that the unmap flushed the stale translations. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((char *) 0x10000000)
+#define PAGE_CNT 40
+#define SIZE (PAGE_CNT * 4096)
+
+void
+test_main (void)
+{
+  int handle;
+  mapid_t map;
+  int sum = 0;
+  size_t i;
+
+  CHECK (create ("big", SIZE), "create \"big\"");
+  CHECK ((handle = open ("big")) > 1, "open \"big\"");
+  CHECK ((map = mmap (handle, ACTUAL)) != MAP_FAILED, "mmap \"big\"");
+  for (i = 0; i < SIZE; i += 4096)
+    sum += ACTUAL[i];
+  msg ("read every page (%d)", sum);
+
+  munmap (map);
+
+  fail ("unmapped memory is readable (%d)", ACTUAL[SIZE - 1]);
+}
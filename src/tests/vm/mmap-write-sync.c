@@ -0,0 +1,39 @@
+/* Maps a file, reads the mapping so that its page is resident, then
+   overwrites part of the file with write().  Verifies that the
+   mapping sees the new bytes, as other mappings of the same file do,
+   and that bytes outside the write are unchanged. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((char *) 0x10000000)
+#define OFFSET 100
+
+static const char overwrite[] = "overwritten by write()";
+
+void
+test_main (void)
+{
+  int handle;
+  mapid_t map;
+
+  CHECK (create ("sample.txt", strlen (sample)), "create \"sample.txt\"");
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (write (handle, sample, strlen (sample)) == (int) strlen (sample),
+         "write \"sample.txt\"");
+  CHECK ((map = mmap (handle, ACTUAL)) != MAP_FAILED, "mmap \"sample.txt\"");
+  CHECK (!memcmp (ACTUAL, sample, strlen (sample)), "read mapping");
+
+  seek (handle, OFFSET);
+  CHECK (write (handle, overwrite, strlen (overwrite))
+         == (int) strlen (overwrite), "overwrite part of \"sample.txt\"");
+  CHECK (!memcmp (ACTUAL + OFFSET, overwrite, strlen (overwrite)),
+         "mapping sees the new bytes");
+  CHECK (!memcmp (ACTUAL, sample, OFFSET), "bytes before are unchanged");
+
+  munmap (map);
+  close (handle);
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-write-sync) begin
+(mmap-write-sync) create "sample.txt"
+(mmap-write-sync) open "sample.txt"
+(mmap-write-sync) write "sample.txt"
+(mmap-write-sync) mmap "sample.txt"
+(mmap-write-sync) read mapping
+(mmap-write-sync) overwrite part of "sample.txt"
+(mmap-write-sync) mapping sees the new bytes
+(mmap-write-sync) bytes before are unchanged
+(mmap-write-sync) end
+EOF
+pass;
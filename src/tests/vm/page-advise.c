@@ -0,0 +1,51 @@
+/* Exercises madvise(): access hints and prefetching on a memory-
+   mapped file, and dropping pages of a mapping and of zero-fill
+   memory. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE (4 * 1024)
+
+static char buf[3 * PAGE];
+
+void
+test_main (void)
+{
+  char *actual = (char *) 0x10000000;
+  char *page = (char *) (((unsigned) buf + PAGE - 1) & ~(PAGE - 1));
+  int handle;
+  mapid_t map;
+  size_t i;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map = mmap (handle, actual)) != MAP_FAILED, "mmap \"sample.txt\"");
+
+  CHECK (madvise (actual, PAGE, MADV_SEQUENTIAL) == 0, "advise sequential");
+  CHECK (madvise (actual, PAGE, MADV_WILLNEED) == 0, "advise willneed");
+  if (memcmp (actual, sample, strlen (sample)))
+    fail ("read of mmap'd file reported bad data");
+
+  /* Changes to a mapped file survive its pages being dropped. */
+  actual[0] = '#';
+  CHECK (madvise (actual, PAGE, MADV_DONTNEED) == 0, "advise dontneed");
+  if (actual[0] != '#'
+      || memcmp (actual + 1, sample + 1, strlen (sample) - 1))
+    fail ("mmap'd file changed by dropping its pages");
+
+  /* Dropped zero-fill pages come back as zeros. */
+  memset (page, 0x5a, PAGE);
+  CHECK (madvise (page, PAGE, MADV_DONTNEED) == 0, "drop written page");
+  for (i = 0; i < PAGE; i++)
+    if (page[i] != 0)
+      fail ("byte %zu of dropped page is %02hhx (should be 0)", i, page[i]);
+
+  CHECK (madvise (page + 1, PAGE, MADV_DONTNEED) == -1, "reject misaligned");
+  CHECK (madvise (page, PAGE, 42) == -1, "reject bad advice");
+
+  munmap (map);
+  close (handle);
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-advise) begin
+(page-advise) open "sample.txt"
+(page-advise) mmap "sample.txt"
+(page-advise) advise sequential
+(page-advise) advise willneed
+(page-advise) advise dontneed
+(page-advise) drop written page
+(page-advise) reject misaligned
+(page-advise) reject bad advice
+(page-advise) end
+EOF
+pass;
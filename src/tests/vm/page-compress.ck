@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-compress) begin
+(page-compress) initialize
+(page-compress) verify pass 0
+(page-compress) verify pass 1
+(page-compress) verify pass 2
+(page-compress) end
+EOF
+pass;
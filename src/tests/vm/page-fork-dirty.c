@@ -0,0 +1,63 @@
+/* Brings a buffer back from swap and changes it, so that its swap
+   slots go stale, then forks, which shares its pages copy-on-write.
+   After the child exits, a read() at end of file into the buffer
+   takes the pages back without writing them.  Checks that the pages
+   stay dirty through that: once evicted again, they must come back
+   with the new contents, not the stale ones in their slots. */
+
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE (4 * 1024)
+#define RSS_PAGES 32
+#define BUF_PAGES 8
+#define FILL_PAGES 64
+
+static char buf[BUF_PAGES * PAGE];
+static char fill[FILL_PAGES * PAGE];
+
+/* Touches every page of FILL, so that the buffer is evicted. */
+static void
+evict_buf (void)
+{
+  size_t i;
+
+  for (i = 0; i < FILL_PAGES; i++)
+    fill[i * PAGE]++;
+}
+
+void
+test_main (void)
+{
+  int handle;
+  pid_t pid;
+  size_t i;
+
+  CHECK (setrss (RSS_PAGES) == 0, "limit to %d pages", RSS_PAGES);
+  for (i = 0; i < BUF_PAGES; i++)
+    buf[i * PAGE] = 1;
+  evict_buf ();
+  for (i = 0; i < BUF_PAGES; i++)
+    buf[i * PAGE] = 2;
+
+  pid = fork ();
+  if (pid == 0)
+    exit (buf[0]);
+  CHECK (pid != PID_ERROR, "fork");
+  CHECK (wait (pid) == 2, "wait for child");
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  seek (handle, sizeof sample - 1);
+  CHECK (read (handle, buf, sizeof buf) == 0, "read at end of file");
+  close (handle);
+
+  evict_buf ();
+  for (i = 0; i < BUF_PAGES; i++)
+    if (buf[i * PAGE] != 2)
+      fail ("page %zu is %d, should be 2", i, buf[i * PAGE]);
+  msg ("check buffer");
+
+  CHECK (setrss (0) == 0, "remove limit");
+}
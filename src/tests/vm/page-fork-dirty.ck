@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-fork-dirty) begin
+(page-fork-dirty) limit to 32 pages
+(page-fork-dirty) fork
+(page-fork-dirty) wait for child
+(page-fork-dirty) open "sample.txt"
+(page-fork-dirty) read at end of file
+(page-fork-dirty) check buffer
+(page-fork-dirty) remove limit
+(page-fork-dirty) end
+EOF
+pass;
@@ -0,0 +1,34 @@
+/* Like page-fork, but runs each child with exec(), so that each one
+   has to build the state again for itself. */
+
+#include <syscall.h>
+#include "tests/vm/fork-work.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static unsigned char buf[FORK_WORK_SIZE];
+
+void
+test_main (void)
+{
+  int sum;
+  int i;
+
+  fork_work_init (buf);
+  sum = fork_work_sum (buf);
+  msg ("init");
+
+  for (i = 0; i < FORK_WORK_ROUNDS; i++)
+    {
+      pid_t pid = exec ("child-fork");
+      if (pid == PID_ERROR)
+        fail ("exec() failed");
+      if (wait (pid) != sum)
+        fail ("child %d saw different state", i);
+    }
+  msg ("run children");
+
+  if (fork_work_sum (buf) != sum)
+    fail ("a child's writes reached the parent");
+  msg ("check state");
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-fork-exec) begin
+(page-fork-exec) init
+(page-fork-exec) run children
+(page-fork-exec) check state
+(page-fork-exec) end
+EOF
+pass;
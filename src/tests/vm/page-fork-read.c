@@ -0,0 +1,39 @@
+/* Forks after writing a buffer, so that parent and child share its
+   frames copy-on-write, then has the child read a file into the
+   buffer.  The read must give the child its own copy of each page
+   before the file system writes into it.  Checks that the child read
+   the file and that the parent's buffer is unchanged. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[sizeof sample];
+
+void
+test_main (void)
+{
+  pid_t pid;
+
+  memset (buf, 'x', sizeof buf);
+  pid = fork ();
+  if (pid == 0)
+    {
+      int handle = open ("sample.txt");
+      if (handle < 2)
+        fail ("open \"sample.txt\" failed");
+      if (read (handle, buf, sizeof sample - 1) != (int) sizeof sample - 1)
+        fail ("read \"sample.txt\" failed");
+      exit (memcmp (buf, sample, sizeof sample - 1) == 0);
+    }
+  CHECK (pid != PID_ERROR, "fork");
+  if (wait (pid) != 1)
+    fail ("child read bad data");
+  msg ("child read \"sample.txt\"");
+
+  if (buf[0] != 'x' || buf[sizeof buf - 1] != 'x')
+    fail ("the child's read reached the parent");
+  msg ("check parent's buffer");
+}
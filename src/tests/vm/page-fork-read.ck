@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-fork-read) begin
+(page-fork-read) fork
+(page-fork-read) child read "sample.txt"
+(page-fork-read) check parent's buffer
+(page-fork-read) end
+EOF
+pass;
@@ -0,0 +1,58 @@
+/* Fills a buffer twice the size of a small user pool, so that much of
+   it is in swap, then forks.  The child gets its own copy of every
+   swapped-out page while it is being set up.  Checks that the child
+   sees the whole buffer, and that the parent still does after the
+   child has written to all of it. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE (4 * 1024)
+#define BUF_SIZE (1024 * 1024)
+
+static char buf[BUF_SIZE];
+
+/* Returns the byte expected at offset I of the buffer. */
+static char
+expected (size_t i)
+{
+  return i / PAGE + i * 7;
+}
+
+/* Checks every byte of the buffer, reporting failures as WHO. */
+static void
+check_buf (const char *who)
+{
+  size_t i;
+
+  for (i = 0; i < BUF_SIZE; i++)
+    if (buf[i] != expected (i))
+      fail ("%s: byte %zu is %d, should be %d", who, i, buf[i],
+            expected (i));
+}
+
+void
+test_main (void)
+{
+  pid_t pid;
+  size_t i;
+
+  for (i = 0; i < BUF_SIZE; i++)
+    buf[i] = expected (i);
+  msg ("fill buffer");
+
+  pid = fork ();
+  if (pid == 0)
+    {
+      check_buf ("child");
+      for (i = 0; i < BUF_SIZE; i += PAGE)
+        buf[i]++;
+      exit (0x42);
+    }
+  CHECK (pid != PID_ERROR, "fork");
+  CHECK (wait (pid) == 0x42, "wait for child");
+
+  check_buf ("parent");
+  msg ("check buffer");
+}
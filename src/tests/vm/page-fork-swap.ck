@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-fork-swap) begin
+(page-fork-swap) fill buffer
+(page-fork-swap) fork
+(page-fork-swap) wait for child
+(page-fork-swap) check buffer
+(page-fork-swap) end
+EOF
+pass;
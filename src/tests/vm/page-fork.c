@@ -0,0 +1,38 @@
+/* Builds some state, then runs a series of children with fork() that
+   each read all of it and write some of it.  Checks that every child
+   saw the parent's state and that none of their writes reached the
+   parent.  Compare the running time with page-fork-exec. */
+
+#include <syscall.h>
+#include "tests/vm/fork-work.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static unsigned char buf[FORK_WORK_SIZE];
+
+void
+test_main (void)
+{
+  int sum;
+  int i;
+
+  fork_work_init (buf);
+  sum = fork_work_sum (buf);
+  msg ("init");
+
+  for (i = 0; i < FORK_WORK_ROUNDS; i++)
+    {
+      pid_t pid = fork ();
+      if (pid == 0)
+        exit (fork_work (buf));
+      if (pid == PID_ERROR)
+        fail ("fork() failed");
+      if (wait (pid) != sum)
+        fail ("child %d saw different state", i);
+    }
+  msg ("run children");
+
+  if (fork_work_sum (buf) != sum)
+    fail ("a child's writes reached the parent");
+  msg ("check state");
+}
@@ -0,0 +1,38 @@
+/* Fills many pages with the same contents and spins for a while, so
+   that KSM can merge them, then writes a different byte to each page
+   and checks that every page kept its own contents. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE (4 * 1024)
+#define PAGE_CNT 64
+#define SPIN_CNT 20000000
+
+static char buf[(PAGE_CNT + 1) * PAGE];
+
+void
+test_main (void)
+{
+  char *start = (char *) (((unsigned) buf + PAGE - 1) & ~(PAGE - 1));
+  volatile unsigned spin;
+  size_t i;
+
+  for (i = 0; i < PAGE_CNT; i++)
+    memset (start + i * PAGE, 0x5a, PAGE);
+  for (spin = 0; spin < SPIN_CNT; spin++)
+    continue;
+  msg ("fill pages");
+
+  for (i = 0; i < PAGE_CNT; i++)
+    start[i * PAGE + i] = i;
+  for (i = 0; i < PAGE_CNT * PAGE; i++)
+    {
+      char expected = i % PAGE == i / PAGE ? (char) (i / PAGE) : 0x5a;
+      if (start[i] != expected)
+        fail ("byte %zu is %d, should be %d", i, start[i], expected);
+    }
+  msg ("write pages");
+}
@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-ksm) begin
+(page-ksm) fill pages
+(page-ksm) write pages
+(page-ksm) end
+EOF
+
+# The pages all hold the same contents, so the KSM thread must have
+# merged some of them before they were written.
+our ($test);
+my ($merged);
+foreach (read_text_file ("$test.output")) {
+    $merged = $1 if /^Frames: \d+ frames scanned by KSM, (\d+) merged away/;
+}
+fail "no KSM statistics in output\n" if !defined $merged;
+fail "KSM merged no frames\n" if $merged == 0;
+pass;
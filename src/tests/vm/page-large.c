@@ -0,0 +1,29 @@
+/* Writes to every page of an 8 MB array in BSS, then checks them all.
+   Run with large pages, at least one aligned 4 MB of the array is
+   mapped by a single large page on the first fault in it, which the
+   page fault and large page counts at shutdown show. */
+
+#include <string.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE (4 * 1024)
+#define SIZE (8 * 1024 * 1024)
+
+static char buf[SIZE];
+
+void
+test_main (void)
+{
+  size_t i;
+
+  for (i = 0; i < SIZE; i += PAGE)
+    buf[i] = i / PAGE;
+  msg ("write pages");
+
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != (i % PAGE ? 0 : (char) (i / PAGE)))
+      fail ("byte %zu is %d, should be %d", i, buf[i],
+            i % PAGE ? 0 : (char) (i / PAGE));
+  msg ("check pages");
+}
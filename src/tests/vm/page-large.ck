@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-large) begin
+(page-large) write pages
+(page-large) check pages
+(page-large) end
+EOF
+pass;
@@ -0,0 +1,44 @@
+/* Limits the process to a small resident set with setrss(), then
+   writes and checks a buffer several times its size, so that the
+   process keeps replacing its own frames.  Then locks more pages
+   than the limit and touches one more, which local replacement
+   cannot serve, so that the frame must come from the global pool. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE (4 * 1024)
+#define RSS_PAGES 32
+#define BUF_PAGES 256
+#define MIN_RSS_PAGES 16
+#define LOCK_PAGES 32
+
+static char buf[BUF_PAGES * PAGE];
+
+void
+test_main (void)
+{
+  size_t i;
+
+  CHECK (setrss (1) == -1, "reject tiny limit");
+  CHECK (setrss (RSS_PAGES) == 0, "limit to %d pages", RSS_PAGES);
+
+  for (i = 0; i < BUF_PAGES; i++)
+    buf[i * PAGE] = i % 251;
+  for (i = 0; i < BUF_PAGES; i++)
+    if (buf[i * PAGE] != (char) (i % 251))
+      fail ("page %zu is %d, should be %d", i, buf[i * PAGE], i % 251);
+  msg ("check buffer");
+
+  CHECK (setrss (MIN_RSS_PAGES) == 0, "limit to %d pages", MIN_RSS_PAGES);
+  CHECK (mlock (buf, LOCK_PAGES * PAGE) == 0, "lock %d pages", LOCK_PAGES);
+  buf[LOCK_PAGES * PAGE] = 1;
+  for (i = 0; i < LOCK_PAGES; i++)
+    if (buf[i * PAGE] != (char) (i % 251))
+      fail ("locked page %zu is %d, should be %d", i, buf[i * PAGE], i % 251);
+  msg ("touch a page past the locked ones");
+  CHECK (munlock (buf, LOCK_PAGES * PAGE) == 0, "unlock %d pages", LOCK_PAGES);
+
+  CHECK (setrss (0) == 0, "remove limit");
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-rss) begin
+(page-rss) reject tiny limit
+(page-rss) limit to 32 pages
+(page-rss) check buffer
+(page-rss) limit to 16 pages
+(page-rss) lock 32 pages
+(page-rss) touch a page past the locked ones
+(page-rss) unlock 32 pages
+(page-rss) remove limit
+(page-rss) end
+EOF
+pass;
@@ -0,0 +1,31 @@
+/* Runs 3 waves of 6 child-linear processes at once, with a small
+   user pool, so that many processes fault, evict and swap at the
+   same time, and processes exit while their pages are being
+   evicted by others. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define WAVE_CNT 3
+#define CHILD_CNT 6
+
+void
+test_main (void)
+{
+  pid_t children[CHILD_CNT];
+  int wave, i;
+
+  for (wave = 0; wave < WAVE_CNT; wave++)
+    {
+      for (i = 0; i < CHILD_CNT; i++)
+        if ((children[i] = exec ("child-linear")) == -1)
+          fail ("exec \"child-linear\" in wave %d", wave);
+
+      for (i = 0; i < CHILD_CNT; i++)
+        if (wait (children[i]) != 0x42)
+          fail ("wait for child %d in wave %d", i, wave);
+
+      msg ("wave %d", wave);
+    }
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-stress) begin
+(page-stress) wave 0
+(page-stress) wave 1
+(page-stress) wave 2
+(page-stress) end
+EOF
+pass;
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-sweep) begin
+(page-sweep) initialize
+(page-sweep) sweep 1
+(page-sweep) sweep 2
+(page-sweep) decrypt
+(page-sweep) end
+EOF
+pass;
@@ -0,0 +1,24 @@
+/* Runs 4 child-linear processes at once in a user pool far too
+   small for all of their working sets, with load control on, so that
+   some of them are deactivated and reactivated while the others
+   finish.  Every child must still complete correctly. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHILD_CNT 4
+
+void
+test_main (void)
+{
+  pid_t children[CHILD_CNT];
+  int i;
+
+  for (i = 0; i < CHILD_CNT; i++)
+    CHECK ((children[i] = exec ("child-linear")) != -1,
+           "exec child %d", i);
+
+  for (i = 0; i < CHILD_CNT; i++)
+    CHECK (wait (children[i]) == 0x42, "wait for child %d", i);
+}
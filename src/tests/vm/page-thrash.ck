@@ -0,0 +1,32 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-thrash) begin
+(page-thrash) exec child 0
+(page-thrash) exec child 1
+(page-thrash) exec child 2
+(page-thrash) exec child 3
+(page-thrash) wait for child 0
+(page-thrash) wait for child 1
+(page-thrash) wait for child 2
+(page-thrash) wait for child 3
+(page-thrash) end
+EOF
+
+# The children finish with load control off too, so check that it
+# deactivated a process and reactivated one.  A process deactivated
+# but never faulting again exits without being reactivated.
+our ($test);
+my ($deactivated, $reactivated);
+foreach (read_text_file ("$test.output")) {
+    ($deactivated, $reactivated) = ($1, $2)
+      if /^Load: \d+ thrashing intervals, (\d+) processes deactivated, (\d+) reactivated/;
+}
+fail "no load control statistics in output\n" if !defined $deactivated;
+fail "load control deactivated no process\n" if $deactivated == 0;
+fail "load control reactivated no process\n" if $reactivated == 0;
+fail "$reactivated processes reactivated, but only $deactivated deactivated\n"
+  if $reactivated > $deactivated;
+pass;
@@ -0,0 +1,36 @@
+/* Reads 4 MB of zero-initialised memory, more than fits in the
+   user pool, then writes to a few scattered pages and verifies
+   that only those pages changed. */
+
+#include <string.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (4 * 1024 * 1024)
+#define PAGE (4 * 1024)
+#define STRIDE (64 * PAGE)
+
+static char buf[SIZE];
+
+void
+test_main (void)
+{
+  size_t i;
+
+  /* Check that it's all zero. */
+  msg ("read pass");
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != 0)
+      fail ("byte %zu != 0", i);
+
+  /* Write to one page in every STRIDE bytes. */
+  msg ("write pass");
+  for (i = 0; i < SIZE; i += STRIDE)
+    memset (buf + i, 0x5a, PAGE);
+
+  /* Check that the written pages, and only those, are 0x5a. */
+  msg ("read pass");
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != (i % STRIDE < PAGE ? 0x5a : 0))
+      fail ("byte %zu has wrong value", i);
+}
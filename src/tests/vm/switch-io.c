@@ -0,0 +1,31 @@
+/* Reads a file from disk over and over.  Each read blocks for the
+   disk, switching to the idle thread and back, so this measures the
+   cost of a round trip between a process and a kernel thread. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define READ_CNT 500
+
+void
+test_main (void)
+{
+  char buf[sizeof sample];
+  int handle;
+  int i;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  for (i = 0; i < READ_CNT; i++)
+    {
+      seek (handle, 0);
+      if (read (handle, buf, sizeof sample - 1) != (int) sizeof sample - 1)
+        fail ("read %d of \"sample.txt\" failed", i);
+      if (memcmp (buf, sample, sizeof sample - 1))
+        fail ("read %d of \"sample.txt\" returned bad data", i);
+    }
+  msg ("read \"sample.txt\" %d times", READ_CNT);
+  close (handle);
+}
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(switch-io) begin
+(switch-io) open "sample.txt"
+(switch-io) read "sample.txt" 500 times
+(switch-io) end
+EOF
+pass;
@@ -0,0 +1,22 @@
+/* Runs 4 child-spin processes at once, so that the timer switches
+   between their address spaces many times. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHILD_CNT 4
+
+void
+test_main (void)
+{
+  pid_t children[CHILD_CNT];
+  int i;
+
+  for (i = 0; i < CHILD_CNT; i++)
+    CHECK ((children[i] = exec ("child-spin")) != -1,
+           "exec \"child-spin\"");
+
+  for (i = 0; i < CHILD_CNT; i++)
+    CHECK (wait (children[i]) == 0x42, "wait for child %d", i);
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(switch-proc) begin
+(switch-proc) exec "child-spin"
+(switch-proc) exec "child-spin"
+(switch-proc) exec "child-spin"
+(switch-proc) exec "child-spin"
+(switch-proc) wait for child 0
+(switch-proc) wait for child 1
+(switch-proc) wait for child 2
+(switch-proc) wait for child 3
+(switch-proc) end
+EOF
+pass;
@@ -39,7 +39,9 @@
 #endif
 #ifdef VM
 #include "vm/frame.h"
+#include "vm/load.h"
 #include "vm/swap.h"
+#include "vm/zswap.h"
 #endif
 
 /* Page directory with kernel mappings only. */
@@ -61,8 +63,39 @@ static const char *swap_bdev_name;
 /* -ul: Maximum number of pages to put into palloc's user pool. */
 static size_t user_page_limit = SIZE_MAX;
 
+#ifdef VM
+/* -pageout-low, -pageout-high: Free frame watermarks for the
+   pageout daemon. */
+static size_t pageout_low_water = FRAME_WATERMARK_DEFAULT;
+static size_t pageout_high_water = FRAME_WATERMARK_DEFAULT;
+
+/* -zswap: Pages of kernel memory for compressed swap. */
+static size_t zswap_pages = ZSWAP_POOL_DEFAULT;
+
+/* -flush: Milliseconds between flushes of dirty mmap pages, or 0
+   to leave them until eviction, msync() or munmap(). */
+static int flush_interval = 0;
+
+/* -rss: Resident-set limit of each process, in pages, or 0 for
+   none. */
+static size_t rss_limit = 0;
+
+/* -thrash: Page-in faults per second that count as thrashing, or 0
+   to turn load control off. */
+static int thrash_rate = 0;
+
+/* -ksm, -ksm-interval: Frames for KSM to scan per pass, or 0 to
+   turn it off, and milliseconds between passes. */
+static size_t ksm_pages = 0;
+static int ksm_interval = 100;
+
+/* -large-pages: Map big zero-fill areas with 4 MB pages. */
+static bool large_pages = false;
+#endif
+
 static void bss_init (void);
 static void paging_init (void);
+static void paging_enable_global (void);
 
 static char **read_command_line (void);
 static char **parse_options (char **argv);
@@ -136,7 +169,20 @@ main (void)
   /* Initialise the frame table. */
   frame_table_init ();
   /* Initialise the swap partition and table. */
-  swap_init ();
+  swap_init (zswap_pages);
+  /* Start reclaiming frames in the background. */
+  frame_pageout_init (pageout_low_water, pageout_high_water);
+  /* Start writing back dirty mmap pages periodically, if asked to. */
+  frame_flusher_init (flush_interval);
+  /* Limit how much of the user pool each process may hold. */
+  frame_rss_init (rss_limit);
+  /* Deactivate processes while the system thrashes, if asked to. */
+  load_init (thrash_rate);
+  /* Merge identical anonymous pages in the background, if asked to. */
+  frame_ksm_init (ksm_interval, ksm_pages);
+  /* Map big zero-fill areas with large pages, if asked to. */
+  if (large_pages)
+    frame_large_init ();
 #endif
 
   printf ("Boot complete.\n");
@@ -193,7 +239,9 @@ paging_init (void)
           pd[pde_idx] = pde_create (pt);
         }
 
-      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text);
+      /* Every page directory shares the kernel's mappings, so
+         they stay valid across a switch of address space. */
+      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text) | PTE_G;
     }
 
   /* Store the physical address of the page directory into CR3
@@ -202,6 +250,29 @@ paging_init (void)
      to/from Control Registers" and [IA32-v3a] 3.7.5 "Base Address
      of the Page Directory". */
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (init_page_dir)));
+
+  paging_enable_global ();
+}
+
+/* Makes the CPU honour the global bit of the kernel's page table
+   entries, if it can, so that loading CR3 on a switch of address
+   space flushes only user mappings from the TLB.  Paging must be on
+   already. */
+static void
+paging_enable_global (void)
+{
+  uint32_t eax = 1, ebx, ecx, edx, cr4;
+
+  /* CPUID function 1 reports PGE in bit 13 of EDX.  See [IA32-v2a]
+     "CPUID--CPU Identification". */
+  asm volatile ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+  if (!(edx & (1 << 13)))
+    return;
+
+  /* Set CR4.PGE.  See [IA32-v3a] 2.5 "Control Registers". */
+  asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+  cr4 |= 1 << 7;
+  asm volatile ("movl %0, %%cr4" : : "r" (cr4) : "memory");
 }
 
 /* Breaks the kernel command line into words and returns them as
@@ -275,6 +346,26 @@ parse_options (char **argv)
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+#endif
+#ifdef VM
+      else if (!strcmp (name, "-pageout-low"))
+        pageout_low_water = atoi (value);
+      else if (!strcmp (name, "-pageout-high"))
+        pageout_high_water = atoi (value);
+      else if (!strcmp (name, "-zswap"))
+        zswap_pages = atoi (value);
+      else if (!strcmp (name, "-flush"))
+        flush_interval = atoi (value);
+      else if (!strcmp (name, "-rss"))
+        rss_limit = atoi (value);
+      else if (!strcmp (name, "-thrash"))
+        thrash_rate = atoi (value);
+      else if (!strcmp (name, "-ksm"))
+        ksm_pages = atoi (value);
+      else if (!strcmp (name, "-ksm-interval"))
+        ksm_interval = atoi (value);
+      else if (!strcmp (name, "-large-pages"))
+        large_pages = true;
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -397,6 +488,17 @@ usage (void)
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+          "  -pageout-low=COUNT Wake the pageout daemon below COUNT free pages.\n"
+          "  -pageout-high=COUNT Let the pageout daemon free up to COUNT pages.\n"
+          "  -zswap=COUNT       Keep up to COUNT pages of compressed swap in RAM.\n"
+          "  -flush=MS          Write back dirty mmap pages every MS milliseconds.\n"
+          "  -rss=COUNT         Limit each process to COUNT resident pages.\n"
+          "  -thrash=RATE       Deactivate processes above RATE page-ins per second.\n"
+          "  -ksm=COUNT         Scan COUNT frames per pass for identical pages.\n"
+          "  -ksm-interval=MS   Wait MS milliseconds between KSM passes.\n"
+          "  -large-pages       Map big zero-fill areas with 4 MB pages.\n"
 #endif
           );
   shutdown_power_off ();
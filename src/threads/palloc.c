@@ -5,6 +5,7 @@
 #include <round.h>
 #include <stdint.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/loader.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -73,7 +74,12 @@ get_pool_for_flags (enum palloc_flags flags)
    otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
    then the pages are filled with zeros.  If too few pages are
    available, returns a null pointer, unless PAL_ASSERT is set in
-   FLAGS, in which case the kernel panics. */
+   FLAGS, in which case the kernel panics.  If PAL_NOBLOCK is set,
+   also returns a null pointer if another thread holds the pool.
+   The bitmap is then searched with interrupts off rather than
+   under the pool lock, so that a thread which never returns to a
+   run queue, such as the idle thread, cannot be preempted while
+   holding the lock and leave others waiting on it forever. */
 void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
 {
@@ -84,15 +90,77 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
   if (page_cnt == 0)
     return NULL;
 
-  lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-  lock_release (&pool->lock);
+  if (flags & PAL_NOBLOCK)
+    {
+      /* The semaphore, not the holder, says whether some thread is
+         inside the critical section: the holder is only set after
+         sema_down() returns. */
+      enum intr_level old_level = intr_disable ();
+      if (pool->lock.semaphore.value == 0)
+        page_idx = BITMAP_ERROR;
+      else
+        page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt,
+                                         false);
+      intr_set_level (old_level);
+    }
+  else
+    {
+      lock_acquire (&pool->lock);
+      page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
+      lock_release (&pool->lock);
+    }
 
   if (page_idx != BITMAP_ERROR)
     pages = pool->base + PGSIZE * page_idx;  
   else
+    pages = NULL;
+
+  if (pages != NULL) 
+    {
+      if (flags & PAL_ZERO)
+        memset (pages, 0, PGSIZE * page_cnt);
+    }
+  else 
+    {
+      if (flags & PAL_ASSERT)
+        PANIC ("palloc_get: out of pages");
+    }
+
+  return pages;
+}
+
+/* Like palloc_get_multiple(), but the PAGE_CNT pages, which must be
+   a power of two, start at a physical address that is a multiple of
+   PAGE_CNT pages, as the hardware requires for a large page.  Never
+   blocks on the pool and never panics: large pages are an
+   optimization, which callers do without if this fails. */
+void *
+palloc_get_aligned (enum palloc_flags flags, size_t page_cnt)
+{
+  struct pool *pool = get_pool_for_flags (flags);
+  size_t pool_cnt = bitmap_size (pool->used_map);
+  size_t page_idx;
+  void *pages = NULL;
+
+  ASSERT (page_cnt != 0 && (page_cnt & (page_cnt - 1)) == 0);
+
+  if (!lock_try_acquire (&pool->lock))
     return NULL;
 
+  /* The first index whose physical page number is aligned. */
+  page_idx = (page_cnt - vtop (pool->base) / PGSIZE % page_cnt) % page_cnt;
+  for (; page_idx + page_cnt <= pool_cnt; page_idx += page_cnt)
+    if (bitmap_none (pool->used_map, page_idx, page_cnt))
+      {
+        bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+        pages = pool->base + PGSIZE * page_idx;
+        break;
+      }
+  lock_release (&pool->lock);
+
+  if (pages != NULL && (flags & PAL_ZERO))
+    memset (pages, 0, PGSIZE * page_cnt);
+
   return pages;
 }
 
@@ -171,6 +239,34 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
+/* Returns the number of pages in the user pool. */
+size_t
+palloc_user_pool_size (void)
+{
+  return bitmap_size (user_pool.used_map);
+}
+
+/* Returns the index within the user pool of PAGE, which must have
+   been allocated from the user pool. */
+size_t
+palloc_user_page_index (const void *page)
+{
+  ASSERT (pg_ofs (page) == 0);
+  ASSERT (page_from_pool (&user_pool, (void *) page));
+
+  return pg_no (page) - pg_no (user_pool.base);
+}
+
+/* Returns the kernel virtual address of the user pool page with
+   the given INDEX. */
+void *
+palloc_user_page_address (size_t index)
+{
+  ASSERT (index < bitmap_size (user_pool.used_map));
+
+  return user_pool.base + index * PGSIZE;
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
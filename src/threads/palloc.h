@@ -9,7 +9,8 @@ enum palloc_flags
   {
     PAL_ASSERT = 001,           /* Panic on failure. */
     PAL_ZERO = 002,             /* Zero page contents. */
-    PAL_USER = 004              /* User page. */
+    PAL_USER = 004,             /* User page. */
+    PAL_NOBLOCK = 010           /* Fail rather than wait for the pool. */
   };
 
 void palloc_init (size_t user_page_limit);
@@ -17,10 +18,15 @@ void *palloc_allocate_mult_frames(enum palloc_flags flags, size_t page_cnt);
 void *palloc_allocate_frame(enum palloc_flags flags);
 void *palloc_get_page (enum palloc_flags);
 void *palloc_get_multiple (enum palloc_flags, size_t page_cnt);
+void *palloc_get_aligned (enum palloc_flags, size_t page_cnt);
 bool palloc_get_multiple_from_address(void *vaddr,
 									  enum palloc_flags flags,
 									  size_t page_cnt);
 void palloc_free_page (void *);
 void palloc_free_multiple (void *, size_t page_cnt);
 
+size_t palloc_user_pool_size (void);
+size_t palloc_user_page_index (const void *page);
+void *palloc_user_page_address (size_t index);
+
 #endif /* threads/palloc.h */
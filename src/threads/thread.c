@@ -15,6 +15,9 @@
 #ifdef USERPROG
 #include "userprog/process.h"
 #endif
+#ifdef VM
+#include "vm/frame.h"
+#endif
 
 /* Random value for struct thread's `magic' member.
    Used to detect stack overflow.  See the big comment at the top
@@ -73,6 +76,7 @@ static void kernel_thread (thread_func *, void *aux);
 static void idle (void *aux UNUSED);
 static struct thread *running_thread (void);
 static struct thread *next_thread_to_run (void);
+static bool no_thread_ready (void);
 static void init_thread (struct thread *, const char *name, int priority);
 static bool is_thread (struct thread *) UNUSED;
 static void thread_enqueue (struct thread *t);
@@ -680,6 +684,14 @@ idle (void *idle_started_ UNUSED)
 
   for (;;) 
     {
+#ifdef VM
+      /* Put the time to use zeroing frames for zero-fill faults, one
+         at a time, so that a thread becoming ready waits at most one
+         page's worth. */
+      while (no_thread_ready () && frame_prezero ())
+        continue;
+#endif
+
       /* Let someone else run. */
       intr_disable ();
       thread_block ();
@@ -790,17 +802,19 @@ alloc_frame (struct thread *t, size_t size)
 static struct thread *
 next_thread_to_run (void) 
 {
-  if (thread_mlfqs) {
-    if (list_empty (&thread_mlfqs_queue))
-      return idle_thread;
-    else
-      return list_entry (list_pop_front (&thread_mlfqs_queue), struct thread, elem);
-  }
-
-  if (list_empty (&ready_list))
+  if (no_thread_ready ())
     return idle_thread;
-  else
-    return list_entry (list_pop_front (&ready_list), struct thread, elem);
+  if (thread_mlfqs)
+    return list_entry (list_pop_front (&thread_mlfqs_queue), struct thread, elem);
+  return list_entry (list_pop_front (&ready_list), struct thread, elem);
+}
+
+/* Returns true if no thread is waiting to run, looking at the run
+   queue of whichever scheduler is in use. */
+static bool
+no_thread_ready (void)
+{
+  return list_empty (thread_mlfqs ? &thread_mlfqs_queue : &ready_list);
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -115,13 +115,26 @@ struct thread
     struct list children;                /* Holds the list of processes started by this process. */
     /* Owned by userprog/process.c. */
     uint32_t *pagedir;                  /* Page directory. */
+    struct pagedir_batch *pagedir_batch; /* Innermost open batch, or null. */
 #endif
 
 #ifdef VM
     struct lock supplemental_page_table_lock; /* Prevents race conditions for access of supplemental page table */              
     struct hash supplemental_page_table;
+    struct list regions;                /* File-backed regions, by address. */
     struct hash mmap_table;
     int next_mmapid;
+    void *fault_around_next;            /* Page a sequential scan would fault on next. */
+    size_t fault_around_window;         /* Pages to read ahead on the next fault. */
+    void *swap_cluster_next;            /* Page that would extend the last swap cluster. */
+    size_t swap_cluster_slot;           /* Swap slot that would extend it. */
+    size_t locked_page_cnt;             /* Pages locked in memory by mlock(). */
+    size_t rss_cnt;                     /* Pages mapped to frames. */
+    size_t rss_limit;                   /* Most pages mapped to frames, or 0. */
+    long long load_fault_cnt;           /* Faults that read a page in. */
+    long long load_fault_last;          /* load_fault_cnt when last sampled. */
+    bool load_suspended;                /* Deactivated by load control. */
+    struct list_elem load_elem;         /* Element in the suspended list. */
 #endif
 
     /* Owned by thread.c. */
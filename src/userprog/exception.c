@@ -3,23 +3,55 @@
 #include <stdio.h>
 #include <string.h>
 #include "userprog/gdt.h"
+#include "userprog/pagedir.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "vm/page.h"
 #include "vm/mmap.h"
 #include "threads/vaddr.h"
 #include "threads/palloc.h"
+#include "userprog/process.h"
+#include "userprog/syscall.h"
+#include "vm/frame.h"
+#include "vm/load.h"
+#include "vm/region.h"
+
+/* Largest number of pages read ahead of a file-backed fault. */
+#define FAULT_AROUND_MAX_WINDOW 16
 
 /* Number of page faults processed. */
 static long long page_fault_cnt;
 
+/* Number of pages mapped speculatively by fault-around, from files
+   and from swap. */
+static long long fault_around_cnt;
+static long long swap_around_cnt;
+
+/* Number of pages read in early at the request of madvise(). */
+static long long prefetch_cnt;
+
+/* Number of zero-fill pages mapped to the shared zero page, and of
+   those later given a private frame by a write. */
+static long long zero_share_cnt;
+static long long zero_copy_cnt;
+
 static void kill (struct intr_frame *);
 static void page_fault (struct intr_frame *);
 
 static bool page_fault_from_swap (struct page *page);
 static bool page_fault_from_filesys (struct page *page);
-static bool page_fault_zero (struct page *page);
+static bool page_fault_zero (struct page *page, bool write);
+static bool page_fault_zero_copy (struct page *page);
+static bool page_fault_large (struct thread *t, struct page *page);
+static bool page_prefetch_file (struct page *page);
 static bool page_fault_memory_mapped (struct page *page);
+static void page_fault_around (struct thread *t, struct page *page);
+static void page_fault_swap_around (struct thread *t, struct page *page);
+static size_t fault_around_window (struct thread *t, struct page *page);
+static bool page_fault_around_candidate (struct page *page,
+                                         struct page *next);
+static void page_fault_file_location (struct page *page, struct file **file,
+                                      off_t *offset, size_t *length);
 
 static void print_page_fault (void *fault_addr,
                               bool not_present,
@@ -83,7 +115,12 @@ exception_init (void)
 void
 exception_print_stats (void) 
 {
-  printf ("Exception: %lld page faults\n", page_fault_cnt);
+  printf ("Exception: %lld page faults, %lld pages faulted around, "
+          "%lld read ahead from swap\n",
+          page_fault_cnt, fault_around_cnt, swap_around_cnt);
+  printf ("Exception: %lld zero pages shared, %lld copied on write\n",
+          zero_share_cnt, zero_copy_cnt);
+  printf ("Exception: %lld pages prefetched by madvise\n", prefetch_cnt);
 }
 
 /* Handler for an exception (probably) caused by a user process. */
@@ -162,6 +199,9 @@ page_fault (struct intr_frame *f)
      be assured of reading CR2 before it changed). */
   intr_enable ();
 
+  /* Count page faults. */
+  page_fault_cnt++;
+
   /* Determine cause. */
   not_present = (f->error_code & PF_P) == 0;
   write = (f->error_code & PF_W) != 0;
@@ -169,23 +209,51 @@ page_fault (struct intr_frame *f)
 
   // These are the cases we want to look at in detail. For everything else,
   // Goto the pagefault message
-  if (!not_present || !fault_addr || !is_user_vaddr(fault_addr))
+  if (!fault_addr || !is_user_vaddr(fault_addr))
+    exit_syscall (-1);
+
+  /* The only present pages that may be written after a fault are
+     zero-fill pages still mapped to the shared zero page, and
+     writable pages whose frame KSM has merged with others. */
+  if (!not_present && !write)
     exit_syscall (-1);
 
   void *vaddr = pg_round_down (fault_addr);
 
   struct thread *t = thread_current ();
-  struct page p;
-  p.vaddr = vaddr;
+
+  /* A process deactivated by load control stops here.  Faults from
+     the kernel may come with locks held, so only user faults do. */
+  if (user)
+    load_wait ();
 
   lock_acquire(&t->supplemental_page_table_lock);
 
-  struct hash_elem *e = hash_find (&t->supplemental_page_table, &p.hash_elem);
+  /* Pages of file-backed regions get their entry on the first fault. */
+  struct page *page = supplemental_lookup_page (t, vaddr);
+
+  if (!not_present)
+  {
+    if (page == NULL
+        || !((page->page_status & PAGE_ZERO_SHARED)
+             || ((page->page_status & PAGE_MERGED) && page->writable)))
+    {
+      lock_release(&t->supplemental_page_table_lock);
+      exit_syscall (-1);
+    }
+
+    if (page->page_status & PAGE_MERGED)
+      frame_unmerge_page (page);
+    else if (!page_fault_zero_copy (page))
+      kill (f);
+
+    goto page_fault_return;
+  }
 
 
   /* If no entry exists in the supplemental page table, check whether the stack
      needs to grow. */
-  if (!e)
+  if (!page)
   {
     ASSERT(is_user_vaddr(fault_addr));
 
@@ -196,8 +264,15 @@ page_fault (struct intr_frame *f)
     goto page_fault_return;
   }
 
-  struct page *page = hash_entry (e, struct page, hash_elem);
+  /* The page may have been unmapped by an eviction that is still
+     saving it.  Its status is only final once that is done. */
+  frame_wait_page (page);
   enum page_status status = page->page_status;
+  if (status & PAGE_IN_MEMORY)
+    goto page_fault_return;
+
+  if (status & (PAGE_SWAP | PAGE_FILESYS | PAGE_MEMORY_MAPPED))
+    load_fault ();
 
   // ASSERT ((status & PAGE_IN_MEMORY) == 0);
 
@@ -207,6 +282,7 @@ page_fault (struct intr_frame *f)
     if (!page_fault_from_swap (page))
       kill (f);
 
+    page_fault_swap_around (t, page);
     goto page_fault_return;
   }
 
@@ -217,12 +293,16 @@ page_fault (struct intr_frame *f)
     if (!page_fault_from_filesys (page))
       kill (f);
 
+    page_fault_around (t, page);
     goto page_fault_return;
   }
 
   if (status & PAGE_ZERO)
   {
-    if (!page_fault_zero (page))
+    if (page_fault_large (t, page))
+      goto page_fault_return;
+
+    if (!page_fault_zero (page, write))
       kill (f);
 
     goto page_fault_return;
@@ -233,6 +313,7 @@ page_fault (struct intr_frame *f)
     if (!page_fault_memory_mapped (page))
       kill (f);
 
+    page_fault_around (t, page);
     goto page_fault_return;
   }
 page_fault_return: 
@@ -243,14 +324,12 @@ page_fault_return:
 static bool
 page_fault_from_swap (struct page *page)
 {
-  struct swap_entry *swap_info = (struct swap_entry *) page->aux;
-  void *kernel_vaddr = frame_allocator_get_user_page(page, 0, true);
+  void *kernel_vaddr = frame_allocator_get_user_page(page, 0, page->writable);
 
-  /* Load the page from swap. */
-  swap_load(swap_info, page, kernel_vaddr);
-
-  /* Free the swap slot. */
-  swap_free(swap_info);
+  /* Load the page from swap.  The page keeps its slot, so that it
+     can be evicted again without a write as long as the dirty bit of
+     its new mapping stays clear. */
+  swap_load(page->swap_slot, kernel_vaddr);
 
   /* Mark the page as no longer in swap, and in memory. */
   page->page_status &= ~PAGE_SWAP;
@@ -262,24 +341,51 @@ page_fault_from_swap (struct page *page)
 static bool
 page_fault_from_filesys (struct page *page)
 {
-  struct page_filesys_info *filesys_info = (struct page_filesys_info *) page->aux;
-  struct file *file = filesys_info->file;
-  size_t ofs = filesys_info->offset;
+  struct file *file = page->region->file;
+  off_t ofs;
+  size_t length;
+
+  region_page_location (page->region, page->vaddr, &ofs, &length);
+
+  /* Read-only pages of the executable are shared between every
+     process running it. */
+  if (!page->writable
+      && frame_cache_get_user_page (page, file_get_inode (file), ofs,
+                                    length, false)) {
+    page->page_status |= PAGE_IN_MEMORY;
+    return true;
+  }
 
   void *kpage = frame_allocator_get_user_page(page, 0, page->writable);
-  if(!read_executable_page(file, ofs, kpage, filesys_info->length, 0))
+  if(!read_executable_page(file, ofs, kpage, length, PGSIZE - length))
     return false;
 
+  if (!page->writable)
+    frame_cache_insert (kpage, file_get_inode (file), ofs, length, false);
+
   /* Mark the page as being in memory. */
   page->page_status |= PAGE_IN_MEMORY;
 
   return true;
 }
 
+/* Handles a fault on a zero-fill page that has no frame.  A read
+   just maps the shared zero page, read-only; only a write needs a
+   frame of its own. */
 static bool
-page_fault_zero (struct page *page)
+page_fault_zero (struct page *page, bool write)
 {
-  frame_allocator_get_user_page(page, PAL_ZERO, true);
+  if (!write)
+  {
+    if (!install_page (page->vaddr, frame_zero_page (), false))
+      return false;
+
+    page->page_status |= PAGE_ZERO_SHARED;
+    zero_share_cnt++;
+    return true;
+  }
+
+  frame_allocator_get_user_page(page, PAL_ZERO, page->writable);
 
   /* Mark the page as being in memory. */
   page->page_status |= PAGE_IN_MEMORY;
@@ -287,32 +393,94 @@ page_fault_zero (struct page *page)
   return true;
 }
 
+/* Tries to map the whole aligned 4 MB around PAGE, a zero-fill page
+   of T's executable, by a single large page of zeroed frames, as for
+   a big array in BSS.  This only works if large pages are enabled and
+   all 4 MB lie in the zero-fill part of PAGE's region and none of it
+   has been touched yet, so none of it is mapped or swapped out.
+   Returns false, leaving the fault to be handled page by page, if
+   not. */
+static bool
+page_fault_large (struct thread *t, struct page *page)
+{
+  struct region *r = page->region;
+  uint8_t *base = (uint8_t *) ((uintptr_t) page->vaddr
+                               & ~(FRAME_LARGE_PAGES * PGSIZE - 1));
+  uint8_t *end = base + FRAME_LARGE_PAGES * PGSIZE;
+  off_t offset;
+  size_t length;
+  uint8_t *vaddr;
+
+  if (!frame_large_enabled () || r == NULL || r->type != PAGE_FILESYS
+      || page->page_status != PAGE_ZERO
+      || base < (uint8_t *) r->start || end > (uint8_t *) r->end
+      || !pagedir_large_page_fits (t->pagedir, base))
+    return false;
+
+  /* The file data of a region comes first, so if the large page
+     starts past it, all of it is zero-fill. */
+  region_page_location (r, base, &offset, &length);
+  if (length != 0)
+    return false;
+
+  for (vaddr = base; vaddr < end; vaddr += PGSIZE)
+    {
+      struct page *p = supplemental_lookup_page (t, vaddr);
+      if (p == NULL || p->page_status != PAGE_ZERO)
+        return false;
+    }
+
+  if (frame_allocator_get_large_page (base, r->writable) == NULL)
+    return false;
+
+  for (vaddr = base; vaddr < end; vaddr += PGSIZE)
+    supplemental_lookup_page (t, vaddr)->page_status |= PAGE_IN_MEMORY;
+  return true;
+}
+
+/* Handles the first write to a zero-fill page mapped to the shared
+   zero page, by replacing that mapping with a private zeroed frame. */
+static bool
+page_fault_zero_copy (struct page *page)
+{
+  pagedir_clear_page (thread_current ()->pagedir, page->vaddr);
+  page->page_status &= ~PAGE_ZERO_SHARED;
+  zero_copy_cnt++;
+
+  return page_fault_zero (page, true);
+}
+
 static bool
 page_fault_memory_mapped (struct page *page)
 {
-  struct page_mmap_info *mmap_info = (struct page_mmap_info *)page->aux;
-  void *kpage = frame_allocator_get_user_page(page, PAL_ZERO, true);
-
-  /* Get the memory-map info from the process's mmap table. */
-  struct mmap_mapping *m = mmap_get_mapping (&thread_current ()->mmap_table,
-                                             mmap_info->mapid);
-  if (!m) {
-    frame_allocator_free_user_page(kpage);
-    exit_syscall (-1);
+  struct file *file = page->region->file;
+  off_t ofs;
+  size_t length;
+
+  region_page_location (page->region, page->vaddr, &ofs, &length);
+
+  /* Share the page with any other mapping of the same file. */
+  if (frame_cache_get_user_page (page, file_get_inode (file), ofs, length,
+                                 true)) {
+    page->page_status |= PAGE_IN_MEMORY;
+    return true;
   }
 
-  struct file *file = m->file;
-  size_t ofs = mmap_info->offset;
-  size_t length = mmap_info->length;
+  void *kpage = frame_allocator_get_user_page(page, 0, true);
 
-  /* Read the data into the page. */
+  /* Read the data into the page, and cache it before the file system
+     lock is released, so that a write() to the file cannot come in
+     between and leave the cached page out of date. */
   start_file_system_access ();
   file_seek (file, ofs);
   int bytes_read = file_read (file, kpage, length);
+  memset ((uint8_t *) kpage + length, 0, PGSIZE - length);
+  if (bytes_read == (int) length)
+    frame_cache_insert (kpage, file_get_inode (file), ofs, length, true);
   end_file_system_access ();
 
-  if (bytes_read != length) {
-    frame_allocator_free_user_page(kpage);
+  if (bytes_read != (int) length) {
+    frame_allocator_free_user_page(page);
     exit_syscall (-1);
   }
 
@@ -321,6 +489,298 @@ page_fault_memory_mapped (struct page *page)
   return true;
 }
 
+/* Reads in pages following PAGE, which has just been faulted in
+   from a file, on the bet that they will be needed soon.
+
+   The number of pages is adaptive.  The window doubles each time a
+   fault lands exactly where the previous batch ended, as happens in a
+   sequential scan, and halves on any other fault, so random access
+   soon stops reading ahead at all.  Only pages of the same mapping
+   that are not resident are read, and only into free frames: read-ahead
+   never evicts.  All of the reads happen under a single acquisition of
+   the file system lock. */
+static void
+page_fault_around (struct thread *t, struct page *page)
+{
+  struct page *batch[FAULT_AROUND_MAX_WINDOW];
+  void *kpages[FAULT_AROUND_MAX_WINDOW];
+  size_t window, cnt, done, i;
+
+  window = fault_around_window (t, page);
+
+  /* Collect the following pages of the same mapping.  Those already
+     in the page cache are simply mapped; the rest each get a frame. */
+  cnt = 0;
+  for (done = 0; done < window; done++)
+    {
+      void *vaddr = (uint8_t *) page->vaddr + (done + 1) * PGSIZE;
+      struct page *next = NULL;
+      struct file *file;
+      off_t offset;
+      size_t length;
+
+      if (!is_user_vaddr (vaddr)
+          || (next = supplemental_lookup_page (t, vaddr)) == NULL
+          || !page_fault_around_candidate (page, next))
+        break;
+
+      page_fault_file_location (next, &file, &offset, &length);
+      if (!next->writable
+          || (next->page_status & PAGE_MEMORY_MAPPED))
+        if (frame_cache_get_user_page (next, file_get_inode (file), offset,
+                                       length, next->writable))
+          {
+            next->page_status |= PAGE_IN_MEMORY;
+            fault_around_cnt++;
+            continue;
+          }
+
+      kpages[cnt] = frame_allocator_get_free_user_page (next, 0,
+                                                        next->writable);
+      if (kpages[cnt] == NULL)
+        break;
+      batch[cnt++] = next;
+    }
+  t->fault_around_next = (uint8_t *) page->vaddr + (done + 1) * PGSIZE;
+
+  if (cnt == 0)
+    return;
+
+  /* Read the whole batch, caching each page as it is read, before a
+     write() to the file can make it out of date. */
+  bool ok[FAULT_AROUND_MAX_WINDOW];
+  start_file_system_access ();
+  for (i = 0; i < cnt; i++)
+    {
+      struct file *file;
+      off_t offset;
+      size_t length;
+
+      page_fault_file_location (batch[i], &file, &offset, &length);
+      ok[i] = file_read_at (file, kpages[i], length, offset) == (off_t) length;
+      memset ((uint8_t *) kpages[i] + length, 0, PGSIZE - length);
+      if (ok[i] && (!batch[i]->writable
+                    || (batch[i]->page_status & PAGE_MEMORY_MAPPED)))
+        frame_cache_insert (kpages[i], file_get_inode (file), offset,
+                            length, batch[i]->writable);
+    }
+  end_file_system_access ();
+
+  /* Publish the pages that were read successfully; give back the
+     frames of any that were not, so they fault normally later. */
+  for (i = 0; i < cnt; i++)
+    if (ok[i])
+      {
+        batch[i]->page_status |= PAGE_IN_MEMORY;
+        fault_around_cnt++;
+      }
+    else
+      frame_allocator_free_user_page (batch[i]);
+}
+
+/* Returns the number of pages to read ahead of a fault on PAGE in
+   thread T.  The window grows on sequential faults and shrinks on
+   random ones, unless madvise() has told us the access pattern of
+   PAGE's region. */
+static size_t
+fault_around_window (struct thread *t, struct page *page)
+{
+  size_t window;
+
+  if (page->region != NULL && page->region->advice == MADV_RANDOM)
+    window = 0;
+  else if (page->region != NULL && page->region->advice == MADV_SEQUENTIAL)
+    window = FAULT_AROUND_MAX_WINDOW;
+  else if (page->vaddr == t->fault_around_next)
+    window = t->fault_around_window == 0 ? 1 : t->fault_around_window * 2;
+  else
+    window = t->fault_around_window / 2;
+  if (window > FAULT_AROUND_MAX_WINDOW)
+    window = FAULT_AROUND_MAX_WINDOW;
+  t->fault_around_window = window;
+
+  return window;
+}
+
+/* Reads in pages following PAGE, which has just been swapped in,
+   with the same adaptive window as page_fault_around().  Only pages
+   whose slots continue PAGE's swap cluster are read, so the reads
+   are to consecutive sectors.  They are mapped with the accessed
+   bit clear, so the clock reclaims them first if the guess was
+   wrong. */
+static void
+page_fault_swap_around (struct thread *t, struct page *page)
+{
+  size_t window, done;
+
+  window = fault_around_window (t, page);
+  for (done = 0; done < window; done++)
+    {
+      void *vaddr = (uint8_t *) page->vaddr + (done + 1) * PGSIZE;
+      struct page *next = NULL;
+      void *kpage;
+
+      if (!is_user_vaddr (vaddr)
+          || !supplemental_entry_exists (&t->supplemental_page_table,
+                                         vaddr, &next)
+          || !(next->page_status & PAGE_SWAP)
+          || next->swap_slot != page->swap_slot + done + 1)
+        break;
+
+      kpage = frame_allocator_get_free_user_page (next, 0, next->writable);
+      if (kpage == NULL)
+        break;
+      swap_load (next->swap_slot, kpage);
+
+      next->page_status &= ~PAGE_SWAP;
+      next->page_status |= PAGE_IN_MEMORY;
+      swap_around_cnt++;
+    }
+  t->fault_around_next = (uint8_t *) page->vaddr + (done + 1) * PGSIZE;
+}
+
+/* Reads in the pages of thread T from START up to END that are
+   neither resident nor zero-fill, for madvise (MADV_WILLNEED).  As
+   with fault-around, only free frames are used, and prefetching stops
+   once there are none left.  Must be called with T's supplemental
+   page table lock held. */
+void
+page_prefetch (struct thread *t, void *start, void *end)
+{
+  uint8_t *vaddr;
+
+  for (vaddr = start; (void *) vaddr < end; vaddr += PGSIZE)
+    {
+      struct page *page = supplemental_lookup_page (t, vaddr);
+      if (page == NULL)
+        continue;
+
+      frame_wait_page (page);
+      if (page->page_status & PAGE_IN_MEMORY)
+        continue;
+
+      if (page->page_status & PAGE_SWAP)
+        {
+          void *kpage = frame_allocator_get_free_user_page (page, 0,
+                                                            page->writable);
+          if (kpage == NULL)
+            break;
+          swap_load (page->swap_slot, kpage);
+
+          page->page_status &= ~PAGE_SWAP;
+          page->page_status |= PAGE_IN_MEMORY;
+          prefetch_cnt++;
+        }
+      else if (page->page_status & (PAGE_FILESYS | PAGE_MEMORY_MAPPED))
+        {
+          if (!page_prefetch_file (page))
+            break;
+        }
+    }
+}
+
+/* Makes PAGE, a page of the running process, resident, as a fault
+   on it would, for mlock().  A zero-fill page gets a frame of its own
+   rather than the shared zero page, which cannot be locked.  Returns
+   false if the page could not be read.  Must be called with the
+   supplemental page table lock held. */
+bool
+page_populate (struct page *page)
+{
+  enum page_status status;
+
+  frame_wait_page (page);
+  status = page->page_status;
+
+  if (status & PAGE_ZERO_SHARED)
+    return page_fault_zero_copy (page);
+  if (status & PAGE_IN_MEMORY)
+    return true;
+  if (status & PAGE_SWAP)
+    return page_fault_from_swap (page);
+  if (status & PAGE_FILESYS)
+    return page_fault_from_filesys (page);
+  if (status & PAGE_ZERO)
+    return page_fault_zero (page, true);
+  if (status & PAGE_MEMORY_MAPPED)
+    return page_fault_memory_mapped (page);
+
+  return false;
+}
+
+/* Reads file-backed PAGE into a free frame, or maps it from the page
+   cache.  Returns false if no frame was free. */
+static bool
+page_prefetch_file (struct page *page)
+{
+  bool shared = !page->writable
+                || (page->page_status & PAGE_MEMORY_MAPPED);
+  struct file *file;
+  off_t offset;
+  size_t length;
+  void *kpage;
+  bool ok;
+
+  page_fault_file_location (page, &file, &offset, &length);
+  if (shared
+      && frame_cache_get_user_page (page, file_get_inode (file), offset,
+                                    length, page->writable))
+    {
+      page->page_status |= PAGE_IN_MEMORY;
+      prefetch_cnt++;
+      return true;
+    }
+
+  kpage = frame_allocator_get_free_user_page (page, 0, page->writable);
+  if (kpage == NULL)
+    return false;
+
+  /* As on a fault, the page is cached before the file system lock is
+     released. */
+  start_file_system_access ();
+  ok = file_read_at (file, kpage, length, offset) == (off_t) length;
+  memset ((uint8_t *) kpage + length, 0, PGSIZE - length);
+  if (ok && shared)
+    frame_cache_insert (kpage, file_get_inode (file), offset, length,
+                        page->writable);
+  end_file_system_access ();
+
+  /* A page that cannot be read is left to fault normally. */
+  if (!ok)
+    {
+      frame_allocator_free_user_page (page);
+      return true;
+    }
+
+  page->page_status |= PAGE_IN_MEMORY;
+  prefetch_cnt++;
+  return true;
+}
+
+/* Stores the file backing PAGE, a file system or memory-mapped
+   page, in *FILE, and the offset and length of its data in the file
+   in *OFFSET and *LENGTH. */
+static void
+page_fault_file_location (struct page *page, struct file **file,
+                          off_t *offset, size_t *length)
+{
+  *file = page->region->file;
+  region_page_location (page->region, page->vaddr, offset, length);
+}
+
+/* Returns true if NEXT may be read in along with PAGE: it must hold
+   file data of the same region and be neither resident nor in
+   swap. */
+static bool
+page_fault_around_candidate (struct page *page, struct page *next)
+{
+  if (next->page_status & (PAGE_IN_MEMORY | PAGE_SWAP))
+    return false;
+
+  return next->region == page->region
+         && (next->page_status & (PAGE_FILESYS | PAGE_MEMORY_MAPPED));
+}
+
 /* Utility function for testing if we need to grow stack. */
 bool
 is_in_vstack(void *ptr, uint32_t *esp)
@@ -1,6 +1,8 @@
 #ifndef USERPROG_EXCEPTION_H
 #define USERPROG_EXCEPTION_H
 
+#include <stdbool.h>
+
 /* Maximum Stack Size: 8 megabytes*/
 #define MAX_STACK_SIZE 8388608
 
@@ -12,4 +14,9 @@
 void exception_init (void);
 void exception_print_stats (void);
 
+struct thread;
+struct page;
+void page_prefetch (struct thread *t, void *start, void *end);
+bool page_populate (struct page *page);
+
 #endif /* userprog/exception.h */
@@ -2,12 +2,34 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <string.h>
+#include <list.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
+#include "threads/thread.h"
 
 static uint32_t *active_pd (void);
-static void invalidate_pagedir (uint32_t *);
+static void invalidate_page (uint32_t *, const void *);
+static void flush_page (const void *);
+static uint32_t *lookup_large_page (uint32_t *pd, const void *vaddr);
+static void split_large_page (uint32_t *pde);
+static uint32_t *take_spare_table (uint32_t *pde);
+
+/* A page set aside, when a large page is mapped, to become the page
+   table that the large page is split into.  Until then the record
+   lives in the page itself.  Splits happen on paths that cannot
+   allocate, such as eviction and KSM merging with interrupts off, so
+   the page must be at hand. */
+struct spare_table
+  {
+    struct list_elem elem;              /* Element in spare_tables. */
+    uint32_t *pde;                      /* Large page it is kept for. */
+  };
+
+/* Spare page tables of all large pages mapped.  Interrupts are off
+   while it is used. */
+static struct list spare_tables = LIST_INITIALIZER (spare_tables);
 
 /* Creates a new page directory that has mappings for kernel
    virtual addresses, but none for user virtual addresses.
@@ -33,7 +55,9 @@ pagedir_destroy (uint32_t *pd)
 
   ASSERT (pd != init_page_dir);
   for (pde = pd; pde < pd + pd_no (PHYS_BASE); pde++)
-    if (*pde & PTE_P) 
+    if ((*pde & PTE_P) && (*pde & PTE_PS))
+      palloc_free_page (take_spare_table (pde));
+    else if (*pde & PTE_P)
       {
         uint32_t *pt = pde_get_pt (*pde);
         uint32_t *pte;
@@ -51,7 +75,9 @@ pagedir_destroy (uint32_t *pd)
    If PD does not have a page table for VADDR, behavior depends
    on CREATE.  If CREATE is true, then a new page table is
    created and a pointer into it is returned.  Otherwise, a null
-   pointer is returned. */
+   pointer is returned.
+   If VADDR is mapped by a large page, the large page is first
+   split into a page table of ordinary pages. */
 static uint32_t *
 lookup_page (uint32_t *pd, const void *vaddr, bool create)
 {
@@ -78,6 +104,8 @@ lookup_page (uint32_t *pd, const void *vaddr, bool create)
       else
         return NULL;
     }
+  else if (*pde & PTE_PS)
+    split_large_page (pde);
 
   /* Return the page table entry. */
   pt = pde_get_pt (*pde);
@@ -115,6 +143,78 @@ pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool writable)
     return false;
 }
 
+/* Maps the 4 MB of user virtual memory starting at UPAGE in page
+   directory PD to the physically contiguous frames starting at
+   KPAGE, by a single large page.  Both addresses must be 4 MB
+   aligned, and large pages must have been enabled with
+   pagedir_enable_large_pages().  PT must be a free kernel page: it is
+   kept to split the large page into, and freed with it.  Returns
+   false if some of the range has a page table already, in which case
+   PT still belongs to the caller. */
+bool
+pagedir_set_large_page (uint32_t *pd, void *upage, void *kpage, void *pt,
+                        bool writable)
+{
+  uint32_t *pde = pd + pd_no (upage);
+  struct spare_table *spare = pt;
+  enum intr_level old_level;
+
+  ASSERT ((uintptr_t) upage % PTSPAN == 0);
+  ASSERT (vtop (kpage) % PTSPAN == 0);
+  ASSERT (is_user_vaddr (upage));
+  ASSERT (pd != init_page_dir);
+
+  ASSERT (pg_ofs (pt) == 0);
+
+  if (*pde != 0)
+    return false;
+
+  spare->pde = pde;
+  old_level = intr_disable ();
+  list_push_back (&spare_tables, &spare->elem);
+  intr_set_level (old_level);
+
+  *pde = vtop (kpage) | PTE_PS | PTE_U | PTE_P | (writable ? PTE_W : 0);
+  return true;
+}
+
+/* Returns true if user virtual page UPAGE in PD is part of a large
+   page. */
+bool
+pagedir_is_large_page (uint32_t *pd, const void *upage)
+{
+  return lookup_large_page (pd, upage) != NULL;
+}
+
+/* Returns true if the 4 MB of user virtual memory starting at UPAGE
+   in page directory PD could be mapped by a large page, because none
+   of it is mapped yet. */
+bool
+pagedir_large_page_fits (uint32_t *pd, const void *upage)
+{
+  return pd[pd_no (upage)] == 0;
+}
+
+/* Turns on support for large pages in the CPU, if it has it, and
+   returns true if it does. */
+bool
+pagedir_enable_large_pages (void)
+{
+  uint32_t eax = 1, ebx, ecx, edx, cr4;
+
+  /* CPUID function 1 reports PSE in bit 3 of EDX.  See [IA32-v2a]
+     "CPUID--CPU Identification". */
+  asm volatile ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+  if (!(edx & (1 << 3)))
+    return false;
+
+  /* Set CR4.PSE.  See [IA32-v3a] 2.5 "Control Registers". */
+  asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+  cr4 |= 1 << 4;
+  asm volatile ("movl %0, %%cr4" : : "r" (cr4) : "memory");
+  return true;
+}
+
 /* Looks up the physical address that corresponds to user virtual
    address UADDR in PD.  Returns the kernel virtual address
    corresponding to that physical address, or a null pointer if
@@ -124,6 +224,10 @@ pagedir_get_page (uint32_t *pd, const void *uaddr)
 {
   uint32_t *pte;
   ASSERT (is_user_vaddr (uaddr));
+
+  pte = lookup_large_page (pd, uaddr);
+  if (pte != NULL)
+    return ptov (*pte & ~(PTSPAN - 1)) + ((uintptr_t) uaddr & (PTSPAN - 1));
   
   pte = lookup_page (pd, uaddr, false);
   if (pte != NULL && (*pte & PTE_P) != 0)
@@ -147,7 +251,7 @@ pagedir_clear_page (uint32_t *pd, void *upage)
   if (pte != NULL && (*pte & PTE_P) != 0)
     {
       *pte &= ~PTE_P;
-      invalidate_pagedir (pd);
+      invalidate_page (pd, upage);
     }
 }
 
@@ -158,16 +262,21 @@ pagedir_clear_page (uint32_t *pd, void *upage)
 bool
 pagedir_is_dirty (uint32_t *pd, const void *vpage) 
 {
-  uint32_t *pte = lookup_page (pd, vpage, false);
+  uint32_t *pte = lookup_large_page (pd, vpage);
+  if (pte == NULL)
+    pte = lookup_page (pd, vpage, false);
   return pte != NULL && (*pte & PTE_D) != 0;
 }
 
 /* Set the dirty bit to DIRTY in the PTE for virtual page VPAGE
-   in PD. */
+   in PD.  A large page only has a dirty bit for all of its pages
+   together, so clearing the bit for one page splits it. */
 void
 pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty) 
 {
-  uint32_t *pte = lookup_page (pd, vpage, false);
+  uint32_t *pte = dirty ? lookup_large_page (pd, vpage) : NULL;
+  if (pte == NULL)
+    pte = lookup_page (pd, vpage, false);
   if (pte != NULL) 
     {
       if (dirty)
@@ -175,7 +284,7 @@ pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty)
       else 
         {
           *pte &= ~(uint32_t) PTE_D;
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 }
@@ -187,16 +296,21 @@ pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty)
 bool
 pagedir_is_accessed (uint32_t *pd, const void *vpage) 
 {
-  uint32_t *pte = lookup_page (pd, vpage, false);
+  uint32_t *pte = lookup_large_page (pd, vpage);
+  if (pte == NULL)
+    pte = lookup_page (pd, vpage, false);
   return pte != NULL && (*pte & PTE_A) != 0;
 }
 
 /* Sets the accessed bit to ACCESSED in the PTE for virtual page
-   VPAGE in PD. */
+   VPAGE in PD.  For a page in a large page, this sets the bit of the
+   whole large page. */
 void
 pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed) 
 {
-  uint32_t *pte = lookup_page (pd, vpage, false);
+  uint32_t *pte = lookup_large_page (pd, vpage);
+  if (pte == NULL)
+    pte = lookup_page (pd, vpage, false);
   if (pte != NULL) 
     {
       if (accessed)
@@ -204,11 +318,97 @@ pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed)
       else 
         {
           *pte &= ~(uint32_t) PTE_A; 
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 }
 
+/* Starts batch B of page table changes made by the running
+   thread.  Until pagedir_batch_commit(), changes that need the TLB
+   invalidated only note the page, so that a bulk operation such as
+   an munmap or an exit invalidates once at the end.  The caller must
+   not depend on a change taking effect before the commit: it may
+   clear a mapping and free the frame, but must not touch the page
+   through the old mapping or map it anew.  Batches nest, and only
+   the outermost one invalidates anything. */
+void
+pagedir_batch_begin (struct pagedir_batch *b)
+{
+  struct thread *t = thread_current ();
+
+  b->outer = t->pagedir_batch;
+  b->page_cnt = 0;
+  t->pagedir_batch = b;
+}
+
+/* Ends batch B, which must be the running thread's innermost batch.
+   A nested batch hands what it put off to the enclosing one.  The
+   outermost batch invalidates it: the noted pages one by one if
+   there are few, otherwise the whole TLB by reloading CR3, which
+   keeps the global kernel entries. */
+void
+pagedir_batch_commit (struct pagedir_batch *b)
+{
+  struct thread *t = thread_current ();
+  struct pagedir_batch *outer = b->outer;
+  size_t i;
+
+  ASSERT (t->pagedir_batch == b);
+  t->pagedir_batch = outer;
+
+  if (outer != NULL)
+    {
+      for (i = 0; i < b->page_cnt && i < PAGEDIR_BATCH_PAGES; i++)
+        if (outer->page_cnt + i < PAGEDIR_BATCH_PAGES)
+          outer->pages[outer->page_cnt + i] = b->pages[i];
+      outer->page_cnt += b->page_cnt;
+    }
+  else if (b->page_cnt > PAGEDIR_BATCH_PAGES)
+    pagedir_activate (active_pd ());
+  else
+    for (i = 0; i < b->page_cnt; i++)
+      flush_page (b->pages[i]);
+}
+
+/* Marks the PAGE_CNT user virtual pages starting at UPAGE "not
+   present" in PD, as pagedir_clear_page() would one at a time, but
+   skipping page tables that are not there and invalidating the TLB
+   once for all of them, at the end of the outermost batch.  Other
+   bits in the page table entries are preserved. */
+void
+pagedir_clear_range (uint32_t *pd, void *upage, size_t page_cnt)
+{
+  struct pagedir_batch b;
+  uint8_t *u = upage;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (page_cnt == 0 || is_user_vaddr (u + page_cnt * PGSIZE - 1));
+
+  pagedir_batch_begin (&b);
+  while (page_cnt > 0)
+    {
+      uint32_t *pte = lookup_page (pd, u, false);
+      size_t span = (PTSPAN - ((uintptr_t) u & (PTSPAN - 1))) / PGSIZE;
+
+      if (span > page_cnt)
+        span = page_cnt;
+      if (pte != NULL)
+        {
+          size_t i;
+
+          for (i = 0; i < span; i++)
+            if ((pte[i] & PTE_P) != 0)
+              {
+                pte[i] &= ~PTE_P;
+                invalidate_page (pd, u + i * PGSIZE);
+              }
+        }
+      u += span * PGSIZE;
+      page_cnt -= span;
+    }
+  pagedir_batch_commit (&b);
+}
+
 /* Loads page directory PD into the CPU's page directory base
    register. */
 void
@@ -225,6 +425,14 @@ pagedir_activate (uint32_t *pd)
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (pd)) : "memory");
 }
 
+/* Returns true if PD, or the base page directory if PD is a null
+   pointer, is the one loaded in the CPU. */
+bool
+pagedir_is_active (uint32_t *pd)
+{
+  return active_pd () == (pd != NULL ? pd : init_page_dir);
+}
+
 /* Returns the currently active page directory. */
 static uint32_t *
 active_pd (void) 
@@ -238,21 +446,91 @@ active_pd (void)
   return ptov (pd);
 }
 
-/* Seom page table changes can cause the CPU's translation
+/* Some page table changes can cause the CPU's translation
    lookaside buffer (TLB) to become out-of-sync with the page
-   table.  When this happens, we have to "invalidate" the TLB by
-   re-activating it.
+   table.  When this happens, we have to "invalidate" the TLB entry
+   for the page that changed.
 
-   This function invalidates the TLB if PD is the active page
+   This function invalidates VADDR's entry if PD is the active page
    directory.  (If PD is not active then its entries are not in
-   the TLB, so there is no need to invalidate anything.) */
+   the TLB, so there is no need to invalidate anything.)  Inside a
+   batch, the invalidation is put off until the batch commits. */
+static void
+invalidate_page (uint32_t *pd, const void *vaddr) 
+{
+  struct pagedir_batch *b;
+
+  if (active_pd () != pd)
+    return;
+
+  b = thread_current ()->pagedir_batch;
+  if (b != NULL)
+    {
+      if (b->page_cnt < PAGEDIR_BATCH_PAGES)
+        b->pages[b->page_cnt] = vaddr;
+      b->page_cnt++;
+    }
+  else
+    flush_page (vaddr);
+}
+
+/* Drops the TLB entry for VADDR, which for a page in a large page
+   is the entry for the whole large page.  See [IA32-v2a] "INVLPG--
+   Invalidate TLB Entry" and [IA32-v3a] 3.12 "Translation Lookaside
+   Buffers (TLBs)". */
+static void
+flush_page (const void *vaddr)
+{
+  asm volatile ("invlpg (%0)" : : "r" (vaddr) : "memory");
+}
+
+/* Returns the page directory entry in PD of the large page mapping
+   VADDR, or a null pointer if VADDR is not in a large page. */
+static uint32_t *
+lookup_large_page (uint32_t *pd, const void *vaddr)
+{
+  uint32_t *pde = pd + pd_no (vaddr);
+
+  return (*pde & (PTE_P | PTE_PS)) == (PTE_P | PTE_PS) ? pde : NULL;
+}
+
+/* Replaces the large page mapped by PDE with a page table of 1,024
+   ordinary pages that map the same frames with the same flags, so
+   that they can be changed one at a time.  The translation stays the
+   same, so the TLB need not be flushed.  The page table is the one
+   set aside when the large page was mapped, so this never allocates
+   or blocks. */
 static void
-invalidate_pagedir (uint32_t *pd) 
+split_large_page (uint32_t *pde)
 {
-  if (active_pd () == pd) 
+  uintptr_t paddr = *pde & ~(PTSPAN - 1);
+  uint32_t flags = *pde & (PTE_P | PTE_W | PTE_U | PTE_A | PTE_D);
+  uint32_t *pt = take_spare_table (pde);
+  size_t i;
+
+  for (i = 0; i < PGSIZE / sizeof *pt; i++)
+    pt[i] = (paddr + i * PGSIZE) | flags;
+  *pde = pde_create (pt);
+}
+
+/* Removes the page table set aside for the large page mapped by PDE
+   from spare_tables and returns it. */
+static uint32_t *
+take_spare_table (uint32_t *pde)
+{
+  enum intr_level old_level = intr_disable ();
+  struct list_elem *e;
+
+  for (e = list_begin (&spare_tables); e != list_end (&spare_tables);
+       e = list_next (e))
     {
-      /* Re-activating PD clears the TLB.  See [IA32-v3a] 3.12
-         "Translation Lookaside Buffers (TLBs)". */
-      pagedir_activate (pd);
-    } 
+      struct spare_table *spare = list_entry (e, struct spare_table, elem);
+      if (spare->pde == pde)
+        {
+          list_remove (e);
+          intr_set_level (old_level);
+          return (uint32_t *) spare;
+        }
+    }
+  NOT_REACHED ();
 }
@@ -2,11 +2,30 @@
 #define USERPROG_PAGEDIR_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+/* Most pages a batch invalidates one by one.  Past this, committing
+   the batch flushes the whole TLB instead. */
+#define PAGEDIR_BATCH_PAGES 32
+
+/* A batch of page table changes whose TLB invalidation is put off
+   until the batch commits. */
+struct pagedir_batch
+  {
+    struct pagedir_batch *outer;        /* Enclosing batch, or null. */
+    size_t page_cnt;                    /* Pages to invalidate. */
+    const void *pages[PAGEDIR_BATCH_PAGES]; /* The first few of them. */
+  };
+
 uint32_t *pagedir_create (void);
 void pagedir_destroy (uint32_t *pd);
 bool pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool rw);
+bool pagedir_set_large_page (uint32_t *pd, void *upage, void *kpage, void *pt,
+                             bool rw);
+bool pagedir_is_large_page (uint32_t *pd, const void *upage);
+bool pagedir_large_page_fits (uint32_t *pd, const void *upage);
+bool pagedir_enable_large_pages (void);
 void *pagedir_get_page (uint32_t *pd, const void *upage);
 void pagedir_clear_page (uint32_t *pd, void *upage);
 bool pagedir_is_dirty (uint32_t *pd, const void *upage);
@@ -14,5 +33,9 @@ void pagedir_set_dirty (uint32_t *pd, const void *upage, bool dirty);
 bool pagedir_is_accessed (uint32_t *pd, const void *upage);
 void pagedir_set_accessed (uint32_t *pd, const void *upage, bool accessed);
 void pagedir_activate (uint32_t *pd);
+bool pagedir_is_active (uint32_t *pd);
+void pagedir_batch_begin (struct pagedir_batch *);
+void pagedir_batch_commit (struct pagedir_batch *);
+void pagedir_clear_range (uint32_t *pd, void *upage, size_t page_cnt);
 
 #endif /* userprog/pagedir.h */
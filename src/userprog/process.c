@@ -14,13 +14,16 @@
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "userprog/syscall.h"
 #include "vm/frame.h"
+#include "vm/load.h"
 #include "vm/page.h"
 #include "vm/mmap.h"
+#include "vm/region.h"
 
 struct argument
 {
@@ -34,8 +37,20 @@ struct stack_setup_data
   int argc;
 };
 
+/* What fork() passes to the child it creates. */
+struct fork_data
+{
+  struct intr_frame if_;        /* The parent's state on entry to fork(). */
+  struct thread *parent;        /* The forking process. */
+};
+
 static struct lock file_system_lock;
 
+/* Number of switches to a process, and how many of them found its
+   page directory loaded already. */
+static long long activate_cnt;
+static long long activate_skip_cnt;
+
 static void
 cleanup_process_info (struct proc_information *process_info);
 
@@ -46,13 +61,14 @@ bool file_descriptor_table_less_func (const struct hash_elem *a,
 void file_descriptor_table_destroy_func (struct hash_elem *e, void *aux);
 
 static thread_func start_process NO_RETURN;
+static thread_func start_fork NO_RETURN;
+static struct proc_information *create_process_info (void);
+static bool fork_address_space (struct thread *parent);
+static bool fork_file_descriptors (struct thread *parent);
 static bool esp_not_in_boundaries(void *esp);
 static bool load (const char *cmdline, void (**eip) (void), void **esp);
 int sum_fileopen(struct thread * t, struct file * f);
 
-bool load_executable_page(struct file *file, off_t offset, void *upage, size_t page_read_bytes,
-                          size_t page_zero_bytes, bool writable);
-
 void
 process_init (void)
 {
@@ -132,31 +148,12 @@ process_execute (const char *file_name)
     struct argument *fst_arg = list_entry(list_back(&setup_data->argv), struct argument, token_list_elem);
 
     // Setup process information shared structure
-    // Initialise and Put together the information struct
-    struct proc_information * proc_info = calloc(1, sizeof(struct proc_information));
+    struct proc_information * proc_info = create_process_info ();
     if (proc_info == NULL) {
       palloc_free_page(fn_copy);
       palloc_free_page(thread_page);
     	return TID_ERROR;
     }
-    // Ensure the calloc call worked correctly
-    ASSERT(proc_info);
-    proc_info->pid = tid;
-    // Initialise Anchor
-    lock_init(&proc_info->anchor);
-    // Initialise life condition
-    cond_init(&proc_info->condvar_process_sync);
-    proc_info->exit_status = UNINITIALISED_EXIT_STATUS;
-    proc_info->child_is_alive = true;
-    proc_info->parent_is_alive = true;
-    proc_info->child_started_correctly = false; // Until it has started
-
-    /* Set up file descriptor table. */
-    hash_init (&proc_info->file_descriptor_table,
-               &file_descriptor_table_hash_function,
-               &file_descriptor_table_less_func,
-               NULL);
-    proc_info->next_fd = 2;
 
     old_level = intr_disable ();
     /* Create a new thread to execute FILE_NAME. */
@@ -189,6 +186,240 @@ process_execute (const char *file_name)
 }
 
 
+/* Creates the information shared between a new process and its
+   parent, with an empty file descriptor table.  Returns NULL if
+   memory is short. */
+static struct proc_information *
+create_process_info (void)
+{
+    // Initialise and Put together the information struct
+    struct proc_information * proc_info = calloc(1, sizeof(struct proc_information));
+    if (proc_info == NULL)
+        return NULL;
+    // Initialise Anchor
+    lock_init(&proc_info->anchor);
+    // Initialise life condition
+    cond_init(&proc_info->condvar_process_sync);
+    proc_info->exit_status = UNINITIALISED_EXIT_STATUS;
+    proc_info->child_is_alive = true;
+    proc_info->parent_is_alive = true;
+    proc_info->child_started_correctly = false; // Until it has started
+
+    /* Set up file descriptor table. */
+    hash_init (&proc_info->file_descriptor_table,
+               &file_descriptor_table_hash_function,
+               &file_descriptor_table_less_func,
+               NULL);
+    proc_info->next_fd = 2;
+
+    return proc_info;
+}
+
+/* Creates a child of the running process with a copy of its address
+   space and open files, which returns to user mode from the same
+   system call, described by F, with a return value of 0.  Returns
+   the child's pid, or EXCEPTION_EXIT_STATUS if it could not be
+   created.
+
+   The copy is made by the child, while the parent waits for it, so
+   nothing changes in the parent's address space meanwhile.  Resident
+   anonymous pages are not copied at all: parent and child share their
+   frames read-only, and whichever writes to one first gets a copy of
+   it, as for pages merged by KSM.  Pages of files are found again
+   through the child's copies of the parent's regions, on its first
+   fault on each of them. */
+pid_t
+process_fork (struct intr_frame *f)
+{
+    struct fork_data data;
+    struct thread *cur = thread_current ();
+    struct proc_information *proc_info;
+    enum intr_level old_level;
+    tid_t tid;
+
+    proc_info = create_process_info ();
+    if (proc_info == NULL)
+        return EXCEPTION_EXIT_STATUS;
+
+    data.if_ = *f;
+    data.parent = cur;
+
+    old_level = intr_disable ();
+    tid = thread_create (cur->name, PRI_DEFAULT, start_fork, &data);
+    if (tid == TID_ERROR)
+    {
+        intr_set_level (old_level);
+        cleanup_process_info (proc_info);
+        return EXCEPTION_EXIT_STATUS;
+    }
+    proc_info->pid = tid;
+    thread_lookup (tid)->proc_info = proc_info;
+    list_push_back (&cur->children, &proc_info->elem);
+    intr_set_level (old_level);
+
+    /* DATA lives on our stack, so we must not return before the child
+       is done with it, whether it succeeded or not. */
+    lock_acquire (&proc_info->anchor);
+    if (proc_info->exit_status == (int) UNINITIALISED_EXIT_STATUS)
+        cond_wait (&proc_info->condvar_process_sync, &proc_info->anchor);
+    if (!proc_info->child_started_correctly)
+        tid = EXCEPTION_EXIT_STATUS;
+    lock_release (&proc_info->anchor);
+
+    return tid;
+}
+
+/* A thread function that copies the process forking it, given by
+   DATA_, and starts the copy running. */
+static void
+start_fork (void *data_)
+{
+    struct fork_data *data = data_;
+    struct thread *cur = thread_current ();
+    struct intr_frame if_ = data->if_;
+    bool success;
+
+    success = fork_address_space (data->parent)
+              && fork_file_descriptors (data->parent);
+
+    // Signal the parent process about the fork's validity.  After this,
+    // DATA is gone.
+    lock_acquire(&cur->proc_info->anchor);
+    cur->proc_info->exit_status = EXCEPTION_EXIT_STATUS;
+    cur->proc_info->child_started_correctly = success;
+    cond_signal(&cur->proc_info->condvar_process_sync, &cur->proc_info->anchor);
+    lock_release(&cur->proc_info->anchor);
+
+    if (!success)
+        thread_exit ();
+
+    /* fork() returns 0 in the child. */
+    if_.eax = 0;
+    asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+    NOT_REACHED ();
+}
+
+/* Gives the running process a copy of the address space of PARENT,
+   which is blocked in fork(): its executable, its regions and memory
+   mappings, each with a file handle of its own, and its pages.
+   Returns false if memory is short. */
+static bool
+fork_address_space (struct thread *parent)
+{
+    struct thread *cur = thread_current ();
+    struct hash_iterator i;
+    struct list_elem *e;
+
+    /* Everything process_exit() frees is set up first, so that it can
+       clean up after a failure at any point. */
+    hash_init (&cur->supplemental_page_table,
+               supplemental_page_table_hash,
+               supplemental_page_table_less,
+               NULL);
+    list_init (&cur->regions);
+    hash_init (&cur->mmap_table, mmap_hash, mmap_less, NULL);
+    cur->next_mmapid = parent->next_mmapid;
+    cur->rss_limit = parent->rss_limit;
+
+    cur->pagedir = pagedir_create ();
+    if (cur->pagedir == NULL)
+        return false;
+    process_activate ();
+
+    start_file_system_access ();
+    cur->file = file_reopen (parent->file);
+    if (cur->file != NULL)
+        file_deny_write (cur->file);
+    end_file_system_access ();
+    if (cur->file == NULL)
+        return false;
+
+    /* The segments of the executable. */
+    for (e = list_begin (&parent->regions); e != list_end (&parent->regions);
+         e = list_next (e))
+    {
+        struct region *r = list_entry (e, struct region, elem);
+
+        if (r->file == parent->file
+            && region_copy (&cur->regions, r, cur->file) == NULL)
+            return false;
+    }
+
+    /* The memory mappings, under the same ids. */
+    hash_first (&i, &parent->mmap_table);
+    while (hash_next (&i))
+    {
+        struct mmap_mapping *mapping = hash_entry (hash_cur (&i),
+                                                   struct mmap_mapping,
+                                                   hash_elem);
+        struct mmap_mapping *copy = malloc (sizeof (struct mmap_mapping));
+        if (copy == NULL)
+            return false;
+
+        start_file_system_access ();
+        copy->file = file_reopen (mapping->file);
+        end_file_system_access ();
+        copy->region = copy->file != NULL
+                       ? region_copy (&cur->regions, mapping->region,
+                                      copy->file)
+                       : NULL;
+        if (copy->region == NULL)
+        {
+            start_file_system_access ();
+            file_close (copy->file);
+            end_file_system_access ();
+            free (copy);
+            return false;
+        }
+        copy->mapid = mapping->mapid;
+        hash_insert (&cur->mmap_table, &copy->hash_elem);
+    }
+
+    return supplemental_fork (parent);
+}
+
+/* Gives the running process a copy of every file descriptor of
+   PARENT, under the same numbers.  Each copy is a file handle of its
+   own, starting at the same position as the original.  Returns false
+   if memory is short. */
+static bool
+fork_file_descriptors (struct thread *parent)
+{
+    struct proc_information *proc_info = thread_current ()->proc_info;
+    struct hash_iterator i;
+    bool success = true;
+
+    start_file_system_access ();
+    hash_first (&i, &parent->proc_info->file_descriptor_table);
+    while (success && hash_next (&i))
+    {
+        struct file_descriptor *descriptor = hash_entry (hash_cur (&i),
+                                                         struct file_descriptor,
+                                                         hash_elem);
+        struct file_descriptor *copy = malloc (sizeof (struct file_descriptor));
+        if (copy == NULL)
+        {
+            success = false;
+            break;
+        }
+
+        copy->file = file_reopen (descriptor->file);
+        if (copy->file == NULL)
+        {
+            free (copy);
+            success = false;
+            break;
+        }
+        file_seek (copy->file, file_tell (descriptor->file));
+        copy->fd = descriptor->fd;
+        hash_insert (&proc_info->file_descriptor_table, &copy->hash_elem);
+    }
+    proc_info->next_fd = parent->proc_info->next_fd;
+    end_file_system_access ();
+
+    return success;
+}
+
 /* A thread function that loads a user process and starts it
    running. */
 static void
@@ -443,12 +674,22 @@ process_exit (void)
     }
 
   #ifdef VM
+    struct pagedir_batch batch;
+
     /* We must destroy the mmap table first, because it needs data from the supplemental
-       page table to terminate cleanly. */
+       page table to terminate cleanly.  Its write-back reads the pages
+       through their user addresses, so the rest of the address space
+       is unmapped only after it, all at once.  Every page goes, so the
+       TLB is invalidated once at the end. */
+    pagedir_batch_begin (&batch);
     hash_destroy (&cur->mmap_table,
                   mmap_table_destroy_func);
+    if (pd != NULL)
+      pagedir_clear_range (pd, NULL, (size_t) PHYS_BASE / PGSIZE);
     hash_destroy (&cur->supplemental_page_table,
                   supplemental_page_table_destroy_func);
+    pagedir_batch_commit (&batch);
+    region_destroy_all (&cur->regions);
   #endif
 
     // Close the executable file, if the file is still open somewhere, writes
@@ -475,6 +716,12 @@ process_exit (void)
         pagedir_activate (NULL);
         pagedir_destroy (pd);
     }
+
+  #ifdef VM
+    /* Only now that it has no page directory will load control no
+       longer pick this thread to deactivate. */
+    load_exit (cur);
+  #endif
 }
 
 static void
@@ -491,14 +738,36 @@ process_activate (void)
 {
     struct thread *t = thread_current ();
 
-    /* Activate thread's page tables. */
-    pagedir_activate (t->pagedir);
+    /* Activate thread's page tables.  Loading CR3 flushes the user
+       part of the TLB, so it is only done for a process whose page
+       directory is not loaded yet.  A kernel thread, or a process
+       that has none yet, uses only the kernel's mappings, which every
+       page directory shares, so it keeps whichever is loaded: a
+       switch from a process to a kernel thread and back then loads
+       nothing at all.  process_exit() loads the base page directory
+       itself before freeing a process's. */
+    if (t->pagedir != NULL)
+    {
+        activate_cnt++;
+        if (pagedir_is_active (t->pagedir))
+            activate_skip_cnt++;
+        else
+            pagedir_activate (t->pagedir);
+    }
 
     /* Set thread's kernel stack for use in processing
        interrupts. */
     tss_update ();
 }
 
+/* Prints statistics about switches between address spaces. */
+void
+process_print_stats (void)
+{
+    printf ("Process: %lld switches to a process, %lld page directory "
+            "loads skipped\n", activate_cnt, activate_skip_cnt);
+}
+
 /* We load ELF binaries.  The following definitions are taken
    from the ELF specification, [ELF1], more-or-less verbatim.  */
 
@@ -592,6 +861,8 @@ load (const char *file_name, void (**eip) (void), void **esp)
                supplemental_page_table_hash,
                supplemental_page_table_less,
                NULL);
+    list_init (&t->regions);
+    t->rss_limit = frame_rss_default ();
 
     /* Initialise the mmap() info for the process. */
     hash_init (&t->mmap_table, mmap_hash, mmap_less, NULL);
@@ -760,8 +1031,9 @@ validate_segment (const struct Elf32_Phdr *phdr, struct file *file)
    The pages initialized by this function must be writable by the
    user process if WRITABLE is true, read-only otherwise.
 
-   Return true if successful, false if a memory allocation error
-   or disk read error occurs. */
+   Nothing is read here: the pages are read in as they are
+   faulted on.  Return true if successful, false if a memory
+   allocation error occurs. */
 static bool
 load_segment (struct file *file, off_t ofs, uint8_t *upage,
               uint32_t read_bytes, uint32_t zero_bytes, bool writable)
@@ -770,96 +1042,11 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
     ASSERT (pg_ofs (upage) == 0);
     ASSERT (ofs % PGSIZE == 0);
 
-    size_t page_index = 0;
-    off_t offset = ofs;
-
-    while (read_bytes > 0 || zero_bytes > 0)
-    {
-        /* Calculate how to fill this page.
-           We will read PAGE_READ_BYTES bytes from FILE
-           and zero the final PAGE_ZERO_BYTES bytes. */
-        size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
-        size_t page_zero_bytes = PGSIZE - page_read_bytes;
-
-        if (!load_executable_page (file, offset, upage, page_read_bytes, page_zero_bytes, writable))
-          return false;
-
-        /* Advance. */
-        read_bytes -= page_read_bytes;
-        zero_bytes -= page_zero_bytes;
-        upage += PGSIZE;
-        offset += PGSIZE;
-
-        ++page_index;
-    }
-    return true;
-}
-
-bool
-load_executable_page(struct file *file, off_t offset, void *upage, size_t page_read_bytes,
-                     size_t page_zero_bytes, bool writable)
-{
-  struct hash *supplemental_page_table = &thread_current ()->supplemental_page_table;
-
-  bool should_read_into_page = false;
-  enum page_status status;
-  struct page* p;
-  /* Three cases for loading a page from an executable. */
-  if (page_read_bytes == PGSIZE) {
-    should_read_into_page = false;
-    status = PAGE_FILESYS;
-  }
-  else if (page_zero_bytes == PGSIZE) {
-    should_read_into_page = false;
-    status = PAGE_ZERO;
-  }
-  else {
-    should_read_into_page = true;
-    status = PAGE_FILESYS;
-  }
-
-  /* Add information about the page to the supplemental page table. */
-  switch (status) {
-    case PAGE_FILESYS:
-    {
-      struct page_filesys_info *filesys_info = malloc(sizeof (struct page_filesys_info));
-      filesys_info->file = file;
-      filesys_info->offset = offset;
-      filesys_info->length = page_read_bytes;
-
-      p = supplemental_create_filesys_page_info (upage, filesys_info, writable);
-      lock_acquire(&thread_current()->supplemental_page_table_lock);
-      supplemental_insert_page_info(supplemental_page_table,p);
-      lock_release(&thread_current()->supplemental_page_table_lock);
-    }
-      break;
-
-    case PAGE_ZERO:
-    {
-      p = supplemental_create_zero_page_info (upage);
-      lock_acquire(&thread_current()->supplemental_page_table_lock);
-      supplemental_insert_page_info(supplemental_page_table,p);
-      lock_release(&thread_current()->supplemental_page_table_lock);
-    }
-      break;
-
-    default:
-      PANIC("Unhandled Load Page Exception");
-      break;
-  }
-
-  /* Allocate a frame for the page if need be. */
-  if (should_read_into_page) {
-    uint8_t *kpage = frame_allocator_get_user_page(p, 0, true);
-
-    if (!read_executable_page (file, offset, kpage, page_read_bytes, page_zero_bytes))
-      return false;
-
-    /* Mark that we have allocated a frame for this page in memory. */
-    supplemental_mark_page_in_memory (supplemental_page_table, upage);
-  }
-
-  return true;
+    /* The whole segment is described by one region; its pages are
+       only set up as they are faulted in. */
+    return region_create (&thread_current ()->regions, upage,
+                          read_bytes + zero_bytes, PAGE_FILESYS, file, ofs,
+                          read_bytes, writable) != NULL;
 }
 
 bool
@@ -4,6 +4,8 @@
 #include "threads/thread.h"
 #include "filesys/file.h"
 
+struct intr_frame;
+
 typedef int pid_t;
 
 #define UNINITIALISED_EXIT_STATUS 0xdeadbeef
@@ -25,11 +27,13 @@ struct proc_information {
 bool install_page (void *upage, void *kpage, bool writable);
 
 pid_t process_execute (const char *file_name);
+pid_t process_fork (struct intr_frame *f);
 
 void process_init (void);
 int process_wait (pid_t);
 void process_exit (void);
 void process_activate (void);
+void process_print_stats (void);
 
 struct file_descriptor *process_get_file_descriptor_struct(int fd);
 void start_file_system_access(void);
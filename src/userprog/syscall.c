@@ -1,12 +1,15 @@
 #include "userprog/syscall.h"
 #include <stdio.h>
+#include <string.h>
 #include <syscall-nr.h>
+#include <round.h>
 #include "threads/malloc.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "userprog/pagedir.h"
 #include "userprog/process.h" 
+#include "userprog/exception.h"
 #include "filesys/filesys.h"
 #include "filesys/file.h"
 #include "devices/shutdown.h"
@@ -14,7 +17,9 @@
 #include "lib/user/syscall.h"
 #include "threads/palloc.h"
 #ifdef VM
+#include "vm/frame.h"
 #include "vm/page.h"
+#include "vm/region.h"
 #endif
 
 typedef void (*SYSCALL_HANDLER)(struct intr_frame *f);
@@ -36,9 +41,16 @@ static void tell_handler      (struct intr_frame *f);
 static void close_handler     (struct intr_frame *f);
 static void mmap_handler      (struct intr_frame *f);
 static void munmap_handler    (struct intr_frame *f);
+static void madvise_handler   (struct intr_frame *f);
+static void msync_handler     (struct intr_frame *f);
+static void mlock_handler     (struct intr_frame *f);
+static void munlock_handler   (struct intr_frame *f);
+static void setrss_handler    (struct intr_frame *f);
+static void fork_handler      (struct intr_frame *f);
 
 uint32_t get_stack_argument(struct intr_frame *f, unsigned int index);
 static void validate_user_pointer (const void *pointer);
+static bool validate_user_range (void *addr, size_t length, void **end);
 
 static const SYSCALL_HANDLER syscall_handlers[] = {
   &halt_handler,
@@ -55,7 +67,13 @@ static const SYSCALL_HANDLER syscall_handlers[] = {
   &tell_handler,
   &close_handler,
   &mmap_handler,
-  &munmap_handler
+  &munmap_handler,
+  &madvise_handler,
+  &msync_handler,
+  &mlock_handler,
+  &munlock_handler,
+  &setrss_handler,
+  &fork_handler
 };
 
 
@@ -218,7 +236,7 @@ read_handler (struct intr_frame *f)
   void *buffer = (void *)get_stack_argument (f, 1);
   unsigned size = (unsigned)get_stack_argument (f, 2);
   void *buffer_page;
-  struct hash *supplemental_page_table = &thread_current ()->supplemental_page_table;
+  bool writable;
 
   validate_user_pointer (buffer);
   validate_user_pointer (buffer+size);
@@ -227,26 +245,20 @@ read_handler (struct intr_frame *f)
   // Grow the stack if necessary.
   lock_acquire(&thread_current()->supplemental_page_table_lock);
   for (buffer_page = pg_round_down(buffer); buffer_page <= buffer+size; buffer_page += PGSIZE){
-    if (is_in_vstack(buffer_page, f->esp)) {
-      struct page p;
-      p.vaddr = buffer_page;    
-      struct hash_elem *e = hash_find (&thread_current()->supplemental_page_table, &p.hash_elem);
-      if (!e) {
-        stack_grow(thread_current(), buffer_page);
-      }
+    if (is_in_vstack(buffer_page, f->esp)
+        && !supplemental_is_mapped (thread_current (), buffer_page, NULL)) {
+      stack_grow(thread_current(), buffer_page);
     }
   }
   lock_release(&thread_current()->supplemental_page_table_lock);
 
-  if (!supplemental_entry_exists (&thread_current ()->supplemental_page_table, buffer, NULL)
-      ||  !supplemental_entry_exists (&thread_current ()->supplemental_page_table, buffer+size, NULL)) {
-    exit_syscall(-1);
-  }
-
-  if (!supplemental_is_page_writable (supplemental_page_table, buffer))  {
+  /* Every page of the buffer must be mapped and writable, so that
+     copying the data out below cannot fail part of the way through. */
+  for (buffer_page = pg_round_down(buffer); buffer_page <= buffer+size; buffer_page += PGSIZE){
+    if (!supplemental_is_mapped (thread_current (), buffer_page, &writable)
+        || !writable)
       exit_syscall(-1);
   }
-  
 
   if (fd == 0) {
     uint8_t value = input_getc();
@@ -262,17 +274,41 @@ read_handler (struct intr_frame *f)
     return;
   }
 
+  /* file_read() runs with the file system lock held, so it must not
+     fault on the user buffer: the fault may need a frame, and evicting
+     a dirty mmap page for it would take the lock again.  The data is
+     read a page at a time into a kernel page instead, and copied out
+     once the lock has been released. */
+  uint8_t *bounce = palloc_get_page (0);
+  if (bounce == NULL) {
+    f->eax = -1;
+    return;
+  }
+
   int bytes_read = -1;
 
   /* We don't allow concurrent filesystem access. */
   start_file_system_access ();
-
   struct file_descriptor *descriptor = process_get_file_descriptor_struct (fd);
+  end_file_system_access ();
+
   if (descriptor != NULL) {
-    bytes_read = (int)file_read (descriptor->file, buffer, size);
+    bytes_read = 0;
+    while ((unsigned) bytes_read < size) {
+      off_t chunk = size - bytes_read < PGSIZE ? size - bytes_read : PGSIZE;
+
+      start_file_system_access ();
+      off_t n = file_read (descriptor->file, bounce, chunk);
+      end_file_system_access ();
+
+      memcpy ((uint8_t *) buffer + bytes_read, bounce, n);
+      bytes_read += n;
+      if (n < chunk)
+        break;
+    }
   }
 
-  end_file_system_access ();
+  palloc_free_page (bounce);
 
   /* Return the result by setting the eax value in the interrupt frame. */
 	f->eax = bytes_read;
@@ -284,14 +320,16 @@ write_handler (struct intr_frame *f)
   int fd = (int)get_stack_argument (f, 0);
   const void *buffer = (const void*)get_stack_argument (f, 1);
   unsigned size = (unsigned)get_stack_argument (f, 2);
+  const void *buffer_page;
   validate_user_pointer (buffer + size);
   validate_user_pointer (buffer);
-  if (!supplemental_entry_exists (&thread_current ()->supplemental_page_table, buffer, NULL)
-      ||  !supplemental_entry_exists (&thread_current ()->supplemental_page_table, buffer+size, NULL)) {
-    exit_syscall(-1);
-  }
 
-  // Ensure that they're in the supplementary page table too.
+  /* Every page of the buffer must be mapped, so that copying the data
+     in below cannot fail part of the way through. */
+  for (buffer_page = pg_round_down(buffer); buffer_page <= buffer+size; buffer_page += PGSIZE){
+    if (!supplemental_is_mapped (thread_current (), (void *) buffer_page, NULL))
+      exit_syscall(-1);
+  }
 
   if (fd == 1) {
     putbuf (buffer, size);
@@ -299,21 +337,52 @@ write_handler (struct intr_frame *f)
     return;
   }
 
+  /* The data is copied a page at a time into a kernel page before the
+     file system lock is taken, for the same reason as in read(), and
+     so that the page cache can be brought up to date from it with the
+     lock still held. */
+  uint8_t *bounce = palloc_get_page (0);
+  if (bounce == NULL) {
+    f->eax = -1;
+    return;
+  }
+
   int bytes_written = -1;
 
   /* We don't allow concurrent filesystem access. */
   start_file_system_access ();
-
   struct file_descriptor *descriptor = process_get_file_descriptor_struct (fd);
+  end_file_system_access ();
+
   if (descriptor != NULL) {
     struct file *file = descriptor->file;
 
-    /* file_write() will handle the case if size is greater than the remaining 
-       size of the file. */
-    bytes_written = (int)file_write (file, buffer, size);
+    bytes_written = 0;
+    while ((unsigned) bytes_written < size) {
+      off_t chunk = size - bytes_written < PGSIZE ? size - bytes_written : PGSIZE;
+
+      memcpy (bounce, (const uint8_t *) buffer + bytes_written, chunk);
+
+      /* file_write() will handle the case if size is greater than the
+         remaining size of the file.  Cached pages of the file, which
+         every mmap of it shares, get the new bytes before the lock is
+         released, so no fault can see the file and the cache
+         disagree. */
+      start_file_system_access ();
+      off_t offset = file_tell (file);
+      off_t n = file_write (file, bounce, chunk);
+#ifdef VM
+      frame_cache_update (file_get_inode (file), offset, bounce, n);
+#endif
+      end_file_system_access ();
+
+      bytes_written += n;
+      if (n < chunk)
+        break;
+    }
   }
 
-  end_file_system_access (); 
+  palloc_free_page (bounce);
 
   /* Return the result by setting the eax value in the interrupt frame. */
 	f->eax = bytes_written;
@@ -406,19 +475,19 @@ mmap_handler (struct intr_frame *f)
     return;
   }
 
-  size_t num_pages = length / PGSIZE;
-  if (length % PGSIZE)
-    num_pages++;
-
-  struct hash *supplemental_page_table = &thread_current ()->supplemental_page_table;
-
-  /* Ensure the space in the user virtual address is not used up. */
-  size_t i;
-  for (i = 0; i < num_pages; ++i) {
-    if (supplemental_entry_exists (supplemental_page_table, addr + i * PGSIZE, NULL)) {
-      f->eax = MMAP_ERROR_MAPID;
-      return;
-    }
+  /* The mapping must fit below the area reserved for the stack, and
+     must not overlap the executable or another mapping.  These are
+     the only other things in the address space, so this check, like
+     the rest of the setup, does not depend on the length of the
+     file. */
+  if ((uint8_t *) addr + length > (uint8_t *) PHYS_BASE - MAX_STACK_SIZE
+      || (uint8_t *) addr + length < (uint8_t *) addr
+      || region_overlaps (&cur->regions, addr, length)) {
+    start_file_system_access ();
+    file_close (file);
+    end_file_system_access ();
+    f->eax = MMAP_ERROR_MAPID;
+    return;
   }
 
   struct mmap_mapping *mapping = malloc (sizeof (struct mmap_mapping));
@@ -427,29 +496,15 @@ mmap_handler (struct intr_frame *f)
 
   mapping->mapid = cur->next_mmapid++;
   mapping->file = file;
-  mapping->uaddr = addr;
-
-  /* Add the mapping entries to the supplemental page table */
-  size_t bytes_into_file = 0;
-  void *uaddr = addr;
-
-  for (i = 0; i < num_pages; ++i) {
-    struct page_mmap_info *mmap_info = malloc (sizeof (struct page_mmap_info));
-    if (!mmap_info)
-      exit_syscall (-1);
-
-    mmap_info->offset = bytes_into_file;
-    mmap_info->length = length - bytes_into_file < PGSIZE ? length - bytes_into_file :
-                                                                 PGSIZE;
-    mmap_info->mapid = mapping->mapid;
 
-    lock_acquire(&cur->supplemental_page_table_lock);
-    struct page * p = supplemental_create_mmap_page_info (uaddr, mmap_info);
-    supplemental_insert_page_info(supplemental_page_table, p);
-    lock_release(&cur->supplemental_page_table_lock);
-    bytes_into_file += PGSIZE;
-    uaddr += PGSIZE;
-  }
+  /* Describe the whole mapping by one region; its pages are set up as
+     they are faulted in. */
+  lock_acquire(&cur->supplemental_page_table_lock);
+  mapping->region = region_create (&cur->regions, addr, length,
+                                   PAGE_MEMORY_MAPPED, file, 0, length, true);
+  lock_release(&cur->supplemental_page_table_lock);
+  if (!mapping->region)
+    exit_syscall (-1);
 
   hash_insert (&cur->mmap_table, &mapping->hash_elem);
 
@@ -474,51 +529,226 @@ munmap_syscall_with_mapping (struct mmap_mapping *mapping, bool should_delete)
 {
   ASSERT (mapping->file);
 
+  struct thread *cur = thread_current ();
+  struct region *r = mapping->region;
+  struct hash *supplemental_page_table = &cur->supplemental_page_table;
+  void *uaddr;
+
+  /* Write the dirty pages back to disk, then free every page that has
+     been loaded.  Pages never touched have no entry and need nothing
+     done.  The whole region is unmapped first, so that the TLB is
+     invalidated once for all of its pages. */
+  mmap_write_back_region (r);
+  pagedir_clear_range (cur->pagedir, r->start,
+                       ((uint8_t *) r->end - (uint8_t *) r->start) / PGSIZE);
+  for (uaddr = r->start; uaddr < r->end; uaddr += PGSIZE) {
+    struct page *page_info = NULL;
+    if (!supplemental_entry_exists (supplemental_page_table, uaddr, &page_info))
+      continue;
+
+    ASSERT (page_info->page_status & PAGE_MEMORY_MAPPED);
+    frame_allocator_free_user_page (page_info);
+
+    supplemental_remove_page_entry (supplemental_page_table, uaddr);
+  }
+  region_destroy (r);
+
+  if (should_delete) {
+    struct mmap_mapping lookup;
+    lookup.mapid = mapping->mapid;
+    hash_delete (&thread_current ()->mmap_table, &lookup.hash_elem);
+  }
+
   start_file_system_access ();
-  size_t length = file_length (mapping->file);
+  file_close (mapping->file);
   end_file_system_access ();
 
-  size_t num_pages = length / PGSIZE;
-  if (length % PGSIZE != 0)
-    num_pages++;
+  free (mapping);
+}
+
+static void
+madvise_handler (struct intr_frame *f)
+{
+  void *addr = (void *)get_stack_argument (f, 0);
+  size_t length = (size_t)get_stack_argument (f, 1);
+  int advice = (int)get_stack_argument (f, 2);
+  struct thread *cur = thread_current ();
+  void *end;
+
+  if (!validate_user_range (addr, length, &end)) {
+    f->eax = -1;
+    return;
+  }
+
+  lock_acquire(&cur->supplemental_page_table_lock);
+  switch (advice) {
+    case MADV_NORMAL:
+    case MADV_RANDOM:
+    case MADV_SEQUENTIAL:
+      region_advise (&cur->regions, addr, length, advice);
+      break;
+
+    case MADV_WILLNEED:
+      page_prefetch (cur, addr, end);
+      break;
+
+    case MADV_DONTNEED:
+    {
+      /* Only pages that have an entry hold anything to drop. */
+      void *uaddr;
+      for (uaddr = addr; uaddr < end; uaddr += PGSIZE) {
+        struct page *page_info = NULL;
+        if (supplemental_entry_exists (&cur->supplemental_page_table, uaddr,
+                                       &page_info))
+          supplemental_discard_page (cur, page_info);
+      }
+    }
+      break;
+
+    default:
+      lock_release(&cur->supplemental_page_table_lock);
+      f->eax = -1;
+      return;
+  }
+  lock_release(&cur->supplemental_page_table_lock);
 
-  size_t i = 0;
-  void *uaddr = mapping->uaddr;
+  f->eax = 0;
+}
+
+static void
+msync_handler (struct intr_frame *f)
+{
+  void *addr = (void *)get_stack_argument (f, 0);
+  size_t length = (size_t)get_stack_argument (f, 1);
+  int flags = (int)get_stack_argument (f, 2);
+  struct thread *cur = thread_current ();
+  void *end;
+  void *uaddr;
 
-  struct hash *supplemental_page_table = &thread_current ()->supplemental_page_table;
+  if (!validate_user_range (addr, length, &end)
+      || (flags & ~(MS_ASYNC | MS_INVALIDATE | MS_SYNC)) != 0
+      || (flags & (MS_ASYNC | MS_SYNC)) == (MS_ASYNC | MS_SYNC)) {
+    f->eax = -1;
+    return;
+  }
 
-  /* Write any pages that have been loaded back to disk. */
-  for (i = 0; i < num_pages; ++i) {
+  /* Pages never touched have no entry, and nothing to write. */
+  lock_acquire(&cur->supplemental_page_table_lock);
+  for (uaddr = addr; uaddr < end; uaddr += PGSIZE) {
     struct page *page_info = NULL;
-    ASSERT (supplemental_entry_exists (supplemental_page_table, uaddr, &page_info));
+    if (supplemental_entry_exists (&cur->supplemental_page_table, uaddr,
+                                   &page_info)
+        && (page_info->page_status & PAGE_MEMORY_MAPPED))
+      frame_sync_user_page (page_info);
+  }
+  lock_release(&cur->supplemental_page_table_lock);
 
-    if (page_info->page_status & PAGE_IN_MEMORY) {
-      ASSERT (page_info->page_status & PAGE_MEMORY_MAPPED);
-      struct page_mmap_info *mmap_info = (struct page_mmap_info *)page_info->aux;
+  f->eax = 0;
+}
+
+static void
+mlock_handler (struct intr_frame *f)
+{
+  void *addr = (void *)get_stack_argument (f, 0);
+  size_t length = (size_t)get_stack_argument (f, 1);
+  struct thread *cur = thread_current ();
+  void *end;
+  void *uaddr;
+  size_t cnt = 0;
 
-      void *kaddr = pagedir_get_page (thread_current ()->pagedir, uaddr);
-      if (pagedir_is_dirty (thread_current ()->pagedir, page_info->vaddr))
-        mmap_write_back_data (mapping, kaddr, mmap_info->offset, mmap_info->length);
+  if (!validate_user_range (addr, length, &end)) {
+    f->eax = -1;
+    return;
+  }
 
-      frame_allocator_free_user_page (kaddr, false);
+  /* The whole range must be mapped, and the pages not locked already
+     must fit within the limits, before anything is locked. */
+  lock_acquire(&cur->supplemental_page_table_lock);
+  for (uaddr = addr; uaddr < end; uaddr += PGSIZE) {
+    struct page *page_info = supplemental_lookup_page (cur, uaddr);
+    if (page_info == NULL) {
+      lock_release(&cur->supplemental_page_table_lock);
+      f->eax = -1;
+      return;
     }
+    if (!page_info->locked)
+      cnt++;
+  }
+  if (!frame_lock_reserve (cnt)) {
+    lock_release(&cur->supplemental_page_table_lock);
+    f->eax = -1;
+    return;
+  }
 
-    supplemental_remove_page_entry (supplemental_page_table, uaddr);
+  /* Lock every page before faulting any in, so that none can be
+     evicted again once it is resident, and so that the reservation is
+     all accounted for by locked pages even if a read fails. */
+  for (uaddr = addr; uaddr < end; uaddr += PGSIZE) {
+    struct page *page_info = supplemental_lookup_page (cur, uaddr);
+    if (!page_info->locked)
+      frame_lock_page (page_info);
+  }
+  for (uaddr = addr; uaddr < end; uaddr += PGSIZE) {
+    struct page *page_info = supplemental_lookup_page (cur, uaddr);
+    if (!page_populate (page_info)) {
+      lock_release(&cur->supplemental_page_table_lock);
+      exit_syscall (-1);
+    }
+  }
+  lock_release(&cur->supplemental_page_table_lock);
+
+  f->eax = 0;
+}
+
+static void
+munlock_handler (struct intr_frame *f)
+{
+  void *addr = (void *)get_stack_argument (f, 0);
+  size_t length = (size_t)get_stack_argument (f, 1);
+  struct thread *cur = thread_current ();
+  void *end;
+  void *uaddr;
 
-    uaddr += PGSIZE;
+  if (!validate_user_range (addr, length, &end)) {
+    f->eax = -1;
+    return;
   }
 
-  if (should_delete) {
-    struct mmap_mapping lookup;
-    lookup.mapid = mapping->mapid;
-    hash_delete (&thread_current ()->mmap_table, &lookup.hash_elem);
+  /* Pages never touched have no entry, and cannot be locked. */
+  lock_acquire(&cur->supplemental_page_table_lock);
+  for (uaddr = addr; uaddr < end; uaddr += PGSIZE) {
+    struct page *page_info = NULL;
+    if (supplemental_entry_exists (&cur->supplemental_page_table, uaddr,
+                                   &page_info))
+      frame_unlock_page (page_info);
   }
+  lock_release(&cur->supplemental_page_table_lock);
 
-  start_file_system_access ();
-  file_close (mapping->file);
-  end_file_system_access ();
+  f->eax = 0;
+}
 
-  free (mapping);
+/* Sets the resident-set limit of the process to the given number of
+   pages, or removes it if that is 0.  Pages already resident beyond a
+   lowered limit are not evicted straight away: the process replaces
+   its own frames as it faults until it is back under the limit. */
+static void
+setrss_handler (struct intr_frame *f)
+{
+  size_t pages = (size_t)get_stack_argument (f, 0);
+
+  if (pages != 0 && pages < FRAME_RSS_MIN) {
+    f->eax = -1;
+    return;
+  }
+
+  thread_current ()->rss_limit = pages;
+  f->eax = 0;
+}
+
+static void
+fork_handler (struct intr_frame *f)
+{
+  f->eax = process_fork (f);
 }
 
 /* Returns whether a user pointer is valid or not. If it is invalid, the callee
@@ -538,6 +768,22 @@ validate_user_pointer (const void *pointer)
 
 }
 
+/* Returns true if the LENGTH bytes from ADDR, which must be page
+   aligned, lie wholly in user memory, and stores the end of the pages
+   they cover in *END.  LENGTH is checked before it is rounded up to a
+   whole number of pages, so that no length can wrap around. */
+static bool
+validate_user_range (void *addr, size_t length, void **end)
+{
+  if (pg_ofs (addr) != 0 || !is_user_vaddr (addr)
+      || length > (size_t) ((uint8_t *) PHYS_BASE - (uint8_t *) addr))
+    return false;
+
+  /* PHYS_BASE is page aligned, so rounding up cannot pass it. */
+  *end = (uint8_t *) addr + ROUND_UP (length, PGSIZE);
+  return true;
+}
+
 uint32_t
 get_stack_argument(struct intr_frame *f, unsigned int index)
 {
@@ -3,258 +3,1778 @@
 #include "vm/swap.h"
 
 #include <debug.h>
+#include <stdio.h>
+#include <string.h>
 
+#include <round.h>
+
+#include "filesys/inode.h"
+#include "devices/timer.h"
+#include "threads/interrupt.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
-#include "threads/malloc.h"
 #include "userprog/pagedir.h"
+#include "vm/mmap.h"
+#include "vm/region.h"
+
+static void frame_map (struct frame *f, struct page *page,
+                       struct thread *owner);
+static bool frame_unmap (struct frame *f, struct page *page);
+
+static struct frame *frame_lookup (void *frame_addr);
+static void *frame_allocator_get (struct page *page, enum palloc_flags flags,
+                                  bool writable, bool may_evict);
+static void *frame_allocator_evict_page (struct thread *owner,
+                                         bool may_wait);
+static struct frame *frame_allocator_choose_eviction_frame (
+  struct thread *owner, bool may_wait);
+static void frame_allocator_save_frame (struct frame*, bool dirty);
+static void frame_allocator_release_page (struct page *page);
+static void frame_write_back (struct frame *f);
+static bool frame_sync (struct frame *f);
+static void frame_flusher (void *aux);
+
+static void *frame_zeroed_get (void);
+
+static void frame_ksm (void *aux);
+static void frame_ksm_scan (struct frame *f);
+static bool frame_ksm_candidate (struct frame *f);
+static bool frame_ksm_merge (struct frame *f, struct frame *into);
+static void frame_ksm_protect (struct frame *f);
+static void frame_ksm_remove (struct frame *f);
+static unsigned frame_ksm_hash (const struct hash_elem *e, void *aux);
+static bool frame_ksm_less (const struct hash_elem *a,
+                            const struct hash_elem *b, void *aux);
+static void frame_save_anonymous (struct frame *f, struct page *page,
+                                  bool dirty);
+
+static void frame_pageout_daemon (void *aux);
+static size_t frame_free_cnt (void);
+static void frame_pageout_poke (void);
+
+static struct frame *frame_clock_advance (void);
+static bool frame_is_evictable (struct frame *f);
+static bool frame_is_clean (struct frame *f);
+static bool frame_test_and_clear_accessed (struct frame *f);
+static bool frame_is_dirty (struct frame *f);
+static bool frame_is_locked (struct frame *f);
+static bool frame_is_owned_by (struct frame *f, struct thread *t);
+
+static struct frame *frame_cache_lookup (block_sector_t sector, off_t offset);
+static void frame_cache_remove (struct frame *f);
+static unsigned frame_cache_hash (const struct hash_elem *e, void *aux);
+static bool frame_cache_less (const struct hash_elem *a,
+                              const struct hash_elem *b, void *aux);
+
+/* Protects the clock ring, every frame's reverse map and busy flag,
+   and the page cache.  It is never held across disk I/O: a frame
+   being evicted is marked busy instead, which keeps it away from
+   other evictors and makes faults on its pages wait for the I/O. */
+static struct lock frame_table_lock;
+
+/* Signalled, with frame_table_lock, whenever a busy frame stops
+   being busy. */
+static struct condition frame_unbusy;
+
+/* The core map: one entry per page of the user pool. */
+static struct frame *frame_table;
+static size_t frame_table_size;
+
+/* Resident frames in allocation order, treated as a circular list.
+   The clock hand points at the next frame to be examined by the
+   eviction scan, or is NULL if the ring is empty. */
+static struct list frame_clock_list;
+static struct list_elem *clock_hand;
+static size_t frame_clock_cnt;
+
+/* A page of zeros, mapped read-only by every zero-fill page that has
+   been read but not yet written.  It comes from the kernel pool, so
+   it has no core map entry and is never evicted. */
+static void *zero_page;
+
+/* Free frames zeroed ahead of time by the idle thread, linked
+   through their clock_elem, which free frames do not otherwise use.
+   Zero-fill faults take a frame from here instead of clearing one
+   themselves.  The idle thread must never block, so the list is
+   protected by disabling interrupts rather than by a lock.  The
+   frames are still counted as free. */
+static struct list zeroed_frames;
+static size_t zeroed_cnt;
+static size_t zeroed_max;             /* 0 until the list is set up. */
+
+/* The page cache: frames holding file pages that may be shared,
+   keyed by the inode sector and page offset they hold.  Protected by
+   frame_table_lock, like every change to a frame's reverse map, so a
+   frame cannot be evicted between being found and being mapped. */
+static struct hash frame_cache;
 
-void frame_map (void *frame_addr, struct page *page, bool writable);
-void frame_unmap (void *frame_addr);
+/* Kernel same-page merging.  Every KSM_INTERVAL milliseconds, the
+   ksm thread hashes the contents of the next ksm_pages anonymous
+   frames of the core map.  Frames are kept in ksm_table by that hash,
+   and a frame whose hash matches another's is compared with it byte
+   for byte and, if identical, merged into it: the pages of both are
+   mapped read-only to one frame, and the other is freed.  A write to a
+   merged page copies it to a private frame again.  An entry in the
+   table may be out of date, since its frame can be written after it
+   is hashed, but nothing is merged without the comparison.  Protected
+   by frame_table_lock. */
+static struct hash ksm_table;
+static size_t ksm_pages;              /* Frames scanned per pass, or 0. */
+static int ksm_interval;              /* Milliseconds between passes. */
+static size_t ksm_cursor;             /* Next frame to scan. */
 
-static unsigned frame_hash (const struct hash_elem *e, void *aux);
-static bool frame_less (const struct hash_elem *a,
-                        const struct hash_elem *b,
-                        void *aux);
-static void *frame_allocator_evict_page (void);
-static struct frame *frame_allocator_choose_eviction_frame (void);
-static void frame_allocator_save_frame (struct frame*);
+/* Background reclaim.  Once fewer than pageout_low_water frames are
+   free, the pageout daemon is woken and evicts frames until
+   pageout_high_water are free again, so that faults can usually take
+   a free frame instead of evicting one themselves.  A low watermark
+   of 0 disables the daemon. */
+static size_t pageout_low_water;
+static size_t pageout_high_water;
+static struct semaphore pageout_wakeup;
+static bool pageout_pending;          /* Daemon woken but not yet done. */
 
-struct lock frame_table_lock;
-struct lock frame_allocation_lock;
+/* Eviction statistics. */
+static long long direct_reclaim_cnt;     /* # of evictions by faults. */
+static long long background_reclaim_cnt; /* # of evictions by the daemon. */
+static long long eviction_cnt;        /* # of frames evicted. */
+static long long dirty_eviction_cnt;  /* # of evictions needing a write. */
+static long long clock_step_cnt;      /* # of frames examined by the hand. */
+static long long cache_hit_cnt;       /* # of faults served by a cached frame. */
+static long long cache_insert_cnt;    /* # of frames entered in the cache. */
+static long long swap_cache_drop_cnt; /* # of evictions kept in swap as is. */
+static long long sync_cnt;            /* # of mmap frames written by msync(). */
+static long long flush_cnt;           /* # of mmap frames written by the flusher. */
+static long long write_back_cnt;      /* # of coalesced writes at munmap. */
+static long long write_back_page_cnt; /* # of mmap frames they covered. */
+static long long prezero_cnt;         /* # of frames zeroed while idle. */
+static long long prezero_hit_cnt;     /* # of zero-fill faults using one. */
+static long long local_reclaim_cnt;   /* # of evictions of a process's own
+                                         frames at its resident-set limit. */
+static long long ksm_scan_cnt;        /* # of frames hashed by KSM. */
+static long long ksm_merge_cnt;       /* # of frames freed by merging. */
+static long long ksm_unmerge_cnt;     /* # of merged pages copied on write. */
+static long long fork_share_cnt;      /* # of pages shared by fork(). */
+static long long large_page_cnt;      /* # of large pages mapped. */
+static long long locked_eviction_cnt; /* # of evictions of a frame of a
+                                         locked page; should stay 0. */
+
+/* Pages locked by mlock() across all processes, and the most there
+   may be, so that eviction always has frames to choose from.
+   Protected by frame_table_lock. */
+static size_t locked_cnt;
+static size_t locked_max;
+
+/* True if faults may map large pages.  See frame_large_init(). */
+static bool large_pages;
+
+/* Resident-set limit given to each new process, in pages, or 0 for
+   none.  See frame_rss_init(). */
+static size_t rss_default;
 
 /* Initialises the frame table. */
 void
 frame_table_init(void)
 {
-  hash_init (&frame_table, frame_hash, frame_less, NULL);
+  size_t i;
+
+  /* The core map lives in the kernel pool for the lifetime of the
+     kernel, so it is never freed. */
+  frame_table_size = palloc_user_pool_size ();
+  frame_table = palloc_get_multiple (PAL_ASSERT | PAL_ZERO,
+                                     DIV_ROUND_UP (frame_table_size
+                                                   * sizeof *frame_table,
+                                                   PGSIZE));
+  for (i = 0; i < frame_table_size; i++)
+    {
+      frame_table[i].frame_addr = palloc_user_page_address (i);
+      list_init (&frame_table[i].mappings);
+    }
+
+  zero_page = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+
   lock_init (&frame_table_lock);
+  cond_init (&frame_unbusy);
+  hash_init (&frame_cache, frame_cache_hash, frame_cache_less, NULL);
+  hash_init (&ksm_table, frame_ksm_hash, frame_ksm_less, NULL);
+
+  list_init (&frame_clock_list);
+  clock_hand = NULL;
+  frame_clock_cnt = 0;
 
-  /* We must prevent multiple pages allocating at the same time to avoid eviction problems. */
-  lock_init (&frame_allocation_lock);
+  list_init (&zeroed_frames);
+  zeroed_cnt = 0;
+  zeroed_max = frame_table_size / 32;
+
+  locked_cnt = 0;
+  locked_max = frame_table_size / 2;
 }
 
-void frame_map(void *frame_addr, struct page *page, bool writable)
-{ 
-  struct frame *new_fr = NULL;
-  new_fr = malloc (sizeof(struct frame));
-  if(!new_fr) 
-    PANIC("Failed to malloc memory for struct frame");
+/* Starts the pageout daemon, which keeps between LOW_WATER and
+   HIGH_WATER user frames free.  Either watermark may be
+   FRAME_WATERMARK_DEFAULT.  Must be called after frame_table_init()
+   and swap_init(). */
+void
+frame_pageout_init (size_t low_water, size_t high_water)
+{
+  if (low_water == FRAME_WATERMARK_DEFAULT)
+    low_water = frame_table_size / 64 > 0 ? frame_table_size / 64 : 1;
+  if (high_water == FRAME_WATERMARK_DEFAULT || high_water < low_water)
+    high_water = 2 * low_water;
+
+  /* Keep at least one frame out of the daemon's reach, or it would
+     try to evict everything. */
+  if (high_water >= frame_table_size)
+    high_water = frame_table_size > 0 ? frame_table_size - 1 : 0;
+  if (low_water > high_water)
+    low_water = high_water;
+
+  pageout_low_water = low_water;
+  pageout_high_water = high_water;
+  sema_init (&pageout_wakeup, 0);
+  pageout_pending = false;
+
+  if (pageout_low_water > 0)
+    thread_create ("pageout", PRI_DEFAULT, frame_pageout_daemon, NULL);
+}
+
+/* Starts the ksm thread, which every INTERVAL_MS milliseconds scans
+   PAGES frames for anonymous pages with identical contents and merges
+   them into a single read-only frame.  Does nothing if PAGES is 0. */
+void
+frame_ksm_init (int interval_ms, size_t pages)
+{
+  if (pages == 0 || interval_ms <= 0)
+    return;
+
+  ksm_pages = pages;
+  ksm_interval = interval_ms;
+  thread_create ("ksm", PRI_MIN, frame_ksm, NULL);
+}
+
+/* Lets faults on big zero-fill areas map FRAME_LARGE_PAGES frames at
+   once by a single 4 MB page, if the CPU supports it.  This saves a
+   fault, a page table entry and a TLB entry for every page after the
+   first. */
+void
+frame_large_init (void)
+{
+  if (pagedir_enable_large_pages ())
+    large_pages = true;
+  else
+    printf ("frame: CPU lacks large pages, not using them\n");
+}
+
+/* Returns true if frame_large_init() turned large pages on. */
+bool
+frame_large_enabled (void)
+{
+  return large_pages;
+}
+
+/* Sets the resident-set limit of each new process to LIMIT pages,
+   or to none if LIMIT is 0.  A process at its limit replaces one of
+   its own frames on a fault instead of taking a free one or evicting
+   another process's, so that a process streaming through more memory
+   than it can use does not push everyone else out.  Limits below
+   FRAME_RSS_MIN are raised to it. */
+void
+frame_rss_init (size_t limit)
+{
+  if (limit != 0 && limit < FRAME_RSS_MIN)
+    limit = FRAME_RSS_MIN;
+  rss_default = limit;
+}
+
+/* Returns the resident-set limit for a new process, as set by
+   frame_rss_init(). */
+size_t
+frame_rss_default (void)
+{
+  return rss_default;
+}
+
+/* Starts the flusher, which writes dirty pages of memory-mapped
+   files back every INTERVAL_MS milliseconds, so that little dirty
+   data builds up between eviction, msync() and munmap().  Does
+   nothing if INTERVAL_MS is 0. */
+void
+frame_flusher_init (int interval_ms)
+{
+  static int interval;
+
+  if (interval_ms <= 0)
+    return;
+
+  interval = interval_ms;
+  thread_create ("flusher", PRI_DEFAULT, frame_flusher, &interval);
+}
 
-  new_fr->page = page;
-  new_fr->frame_addr = frame_addr;
-  new_fr->owner_id = thread_current()->tid;
-  new_fr->unused_count = 0;
+/* The flusher.  Each pass visits the core map in order, writing back
+   every resident memory-mapped frame that has been written to.  The
+   pages stay mapped. */
+static void
+frame_flusher (void *interval_)
+{
+  int *interval = interval_;
+
+  for (;;)
+    {
+      size_t i;
+
+      timer_msleep (*interval);
+      for (i = 0; i < frame_table_size; i++)
+        {
+          lock_acquire (&frame_table_lock);
+          if (frame_sync (&frame_table[i]))
+            flush_cnt++;
+          lock_release (&frame_table_lock);
+        }
+    }
+}
+
+/* Writes PAGE back to its file if it is a resident memory-mapped
+   page that has been written to since it was last saved, and leaves
+   it mapped, as for msync().  Returns true if it was written. */
+bool
+frame_sync_user_page (struct page *page)
+{
+  bool written = false;
 
   lock_acquire (&frame_table_lock);
-  hash_insert(&frame_table, &new_fr->hash_elem);
+  while (page->frame != NULL && page->frame->busy)
+    cond_wait (&frame_unbusy, &frame_table_lock);
+
+  if (page->frame != NULL && frame_sync (page->frame))
+    {
+      sync_cnt++;
+      written = true;
+    }
   lock_release (&frame_table_lock);
+
+  return written;
 }
 
-void frame_unmap(void *frame_addr)
+/* If F holds a memory-mapped page that any of its mappings has
+   written, clears the dirty bits and writes the frame back to its
+   file.  The bits are cleared before the write, so a store made
+   during it marks the page dirty again and is not lost.  Returns true
+   if the frame was written.  Must be called with frame_table_lock
+   held. */
+static bool
+frame_sync (struct frame *f)
 {
-  struct frame f;
-  f.frame_addr = frame_addr;
+  struct list_elem *e;
 
-  lock_acquire (&frame_table_lock);
-  hash_delete (&frame_table, &f.hash_elem);
+  if (list_empty (&f->mappings) || f->busy || !frame_is_evictable (f))
+    return false;
+
+  struct page *page = list_entry (list_front (&f->mappings),
+                                  struct page, frame_elem);
+  if (!(page->page_status & PAGE_MEMORY_MAPPED) || !frame_is_dirty (f))
+    return false;
+
+  for (e = list_begin (&f->mappings); e != list_end (&f->mappings);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, frame_elem);
+      pagedir_set_dirty (p->owner->pagedir, p->vaddr, false);
+    }
+  frame_write_back (f);
+
+  return true;
+}
+
+/* Writes F, which holds a memory-mapped page, back to its file.  The
+   frame is marked busy and frame_table_lock released during the
+   write, so that the frame can be neither evicted nor reused under
+   it.  Must be called with frame_table_lock held. */
+static void
+frame_write_back (struct frame *f)
+{
+  struct page *page = list_entry (list_front (&f->mappings),
+                                  struct page, frame_elem);
+  off_t offset;
+  size_t length;
+
+  ASSERT (!f->busy);
+
+  f->busy = true;
   lock_release (&frame_table_lock);
+
+  region_page_location (page->region, page->vaddr, &offset, &length);
+  mmap_write_back_data (page->region->file, f->frame_addr, offset, length);
+
+  lock_acquire (&frame_table_lock);
+  f->busy = false;
+  cond_broadcast (&frame_unbusy, &frame_table_lock);
+}
+
+/* The ksm thread.  Scans ksm_pages frames every ksm_interval
+   milliseconds, taking frame_table_lock for one frame at a time. */
+static void
+frame_ksm (void *aux UNUSED)
+{
+  for (;;)
+    {
+      size_t i;
+
+      timer_msleep (ksm_interval);
+      for (i = 0; i < ksm_pages; i++)
+        {
+          lock_acquire (&frame_table_lock);
+          frame_ksm_scan (&frame_table[ksm_cursor]);
+          lock_release (&frame_table_lock);
+          ksm_cursor = (ksm_cursor + 1) % frame_table_size;
+        }
+    }
+}
+
+/* Hashes F, if it is an anonymous frame, and merges it with a frame
+   of the same contents if there is one in the KSM table, or else
+   enters it in the table.  Must be called with frame_table_lock
+   held. */
+static void
+frame_ksm_scan (struct frame *f)
+{
+  struct hash_elem *e;
+  struct frame *twin;
+  unsigned hash;
+
+  if (!frame_ksm_candidate (f))
+    return;
+
+  hash = hash_bytes (f->frame_addr, PGSIZE);
+  ksm_scan_cnt++;
+  if (f->ksm_listed)
+    {
+      if (f->ksm_hash == hash)
+        return;
+      frame_ksm_remove (f);
+    }
+  f->ksm_hash = hash;
+
+  e = hash_insert (&ksm_table, &f->ksm_elem);
+  if (e == NULL)
+    {
+      f->ksm_listed = true;
+      return;
+    }
+
+  /* Merge into the frame already shared the most, which then stays
+     in the table.  If the twin has changed since it was hashed, F
+     takes its place there instead.  A twin merged into F has left
+     the table already, on being freed. */
+  twin = hash_entry (e, struct frame, ksm_elem);
+  if (!frame_ksm_candidate (twin))
+    return;
+  if (list_size (&f->mappings) <= list_size (&twin->mappings))
+    {
+      if (frame_ksm_merge (f, twin))
+        return;
+      frame_ksm_remove (twin);
+    }
+  else if (!frame_ksm_merge (twin, f))
+    frame_ksm_remove (twin);
+
+  hash_insert (&ksm_table, &f->ksm_elem);
+  f->ksm_listed = true;
+}
+
+/* Returns true if F holds anonymous pages that KSM may merge: every
+   page mapping it is resident, none is locked in memory, and none is
+   part of a large page, which merging would have to split. */
+static bool
+frame_ksm_candidate (struct frame *f)
+{
+  struct list_elem *e;
+
+  if (list_empty (&f->mappings) || f->busy || f->cached)
+    return false;
+
+  for (e = list_begin (&f->mappings); e != list_end (&f->mappings);
+       e = list_next (e))
+    {
+      struct page *page = list_entry (e, struct page, frame_elem);
+      if ((page->page_status & (PAGE_FILESYS | PAGE_MEMORY_MAPPED))
+          || !(page->page_status & PAGE_IN_MEMORY) || page->locked
+          || pagedir_is_large_page (page->owner->pagedir, page->vaddr))
+        return false;
+    }
+
+  return true;
+}
+
+/* If F and INTO have the same contents, maps every page of F to INTO
+   read-only, makes the pages of INTO read-only too, and frees F.
+   Returns true if the frames were merged.  Interrupts are off from
+   the comparison until every page is read-only, so that no process
+   can write to either frame in between.  Must be called with
+   frame_table_lock held. */
+static bool
+frame_ksm_merge (struct frame *f, struct frame *into)
+{
+  enum intr_level old_level;
+  bool same;
+
+  ASSERT (f != into);
+
+  old_level = intr_disable ();
+  same = !memcmp (f->frame_addr, into->frame_addr, PGSIZE);
+  if (same)
+    {
+      frame_ksm_protect (into);
+      while (!list_empty (&f->mappings))
+        {
+          struct page *page = list_entry (list_front (&f->mappings),
+                                          struct page, frame_elem);
+          struct thread *owner = page->owner;
+          bool dirty = pagedir_is_dirty (owner->pagedir, page->vaddr);
+
+          pagedir_clear_page (owner->pagedir, page->vaddr);
+          frame_unmap (f, page);
+          pagedir_set_page (owner->pagedir, page->vaddr, into->frame_addr,
+                            false);
+          pagedir_set_dirty (owner->pagedir, page->vaddr, dirty);
+          frame_map (into, page, owner);
+          page->page_status |= PAGE_MERGED;
+        }
+    }
+  intr_set_level (old_level);
+
+  if (same)
+    {
+      palloc_free_page (f->frame_addr);
+      ksm_merge_cnt++;
+    }
+  return same;
 }
 
+/* Maps every page of F that is not yet merged read-only, keeping its
+   dirty bit, which says whether its swap slot is still valid.  Must
+   be called with interrupts off. */
+static void
+frame_ksm_protect (struct frame *f)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&f->mappings); e != list_end (&f->mappings);
+       e = list_next (e))
+    {
+      struct page *page = list_entry (e, struct page, frame_elem);
+      uint32_t *pd = page->owner->pagedir;
+      bool dirty;
+
+      if (page->page_status & PAGE_MERGED)
+        continue;
+
+      dirty = pagedir_is_dirty (pd, page->vaddr);
+      pagedir_clear_page (pd, page->vaddr);
+      pagedir_set_page (pd, page->vaddr, f->frame_addr, false);
+      pagedir_set_dirty (pd, page->vaddr, dirty);
+      page->page_status |= PAGE_MERGED;
+    }
+}
+
+/* Takes F out of the KSM table, if it is there. */
+static void
+frame_ksm_remove (struct frame *f)
+{
+  if (f->ksm_listed)
+    {
+      hash_delete (&ksm_table, &f->ksm_elem);
+      f->ksm_listed = false;
+    }
+}
 
-/* Hash function for the frame table. */
 static unsigned
-frame_hash(const struct hash_elem *e, void *aux UNUSED)
+frame_ksm_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_entry (e, struct frame, ksm_elem)->ksm_hash;
+}
+
+static bool
+frame_ksm_less (const struct hash_elem *a, const struct hash_elem *b,
+                void *aux UNUSED)
+{
+  return hash_entry (a, struct frame, ksm_elem)->ksm_hash
+         < hash_entry (b, struct frame, ksm_elem)->ksm_hash;
+}
+
+/* Returns the number of user pool frames not holding a page. */
+static size_t
+frame_free_cnt (void)
+{
+  return frame_table_size - frame_clock_cnt;
+}
+
+/* Wakes the pageout daemon if free frames have run low and it is not
+   already running. */
+static void
+frame_pageout_poke (void)
+{
+  if (pageout_low_water == 0 || pageout_pending
+      || frame_free_cnt () >= pageout_low_water)
+    return;
+
+  pageout_pending = true;
+  sema_up (&pageout_wakeup);
+}
+
+/* The pageout daemon.  Sleeps until poked, then evicts frames with
+   the same WSClock policy as direct reclaim until the high
+   watermark is reached.  Faults run alongside it, and may evict
+   frames of their own at the same time. */
+static void
+frame_pageout_daemon (void *aux UNUSED)
+{
+  for (;;)
+    {
+      sema_down (&pageout_wakeup);
+
+      while (frame_free_cnt () < pageout_high_water)
+        {
+          void *kernel_vaddr = frame_allocator_evict_page (NULL, false);
+          if (kernel_vaddr == NULL)
+            break;
+          palloc_free_page (kernel_vaddr);
+          background_reclaim_cnt++;
+        }
+
+      pageout_pending = false;
+    }
+}
+
+/* Zeroes one free frame and adds it to the pre-zeroed pool, unless
+   the pool is full or no frame can be had without waiting.  Returns
+   true if a frame was zeroed.  Called by the idle thread, so it never
+   blocks. */
+bool
+frame_prezero (void)
+{
+  enum intr_level old_level;
+  void *kernel_vaddr;
+
+  if (zeroed_cnt >= zeroed_max)
+    return false;
+
+  kernel_vaddr = palloc_get_page (PAL_USER | PAL_NOBLOCK);
+  if (kernel_vaddr == NULL)
+    return false;
+  memset (kernel_vaddr, 0, PGSIZE);
+
+  old_level = intr_disable ();
+  list_push_back (&zeroed_frames, &frame_lookup (kernel_vaddr)->clock_elem);
+  zeroed_cnt++;
+  intr_set_level (old_level);
+
+  prezero_cnt++;
+  return true;
+}
+
+/* Takes a frame from the pre-zeroed pool and returns its kernel
+   address, or returns NULL if the pool is empty. */
+static void *
+frame_zeroed_get (void)
+{
+  enum intr_level old_level;
+  struct frame *f = NULL;
+
+  old_level = intr_disable ();
+  if (!list_empty (&zeroed_frames))
+    {
+      f = list_entry (list_pop_front (&zeroed_frames), struct frame,
+                      clock_elem);
+      zeroed_cnt--;
+    }
+  intr_set_level (old_level);
+
+  return f != NULL ? f->frame_addr : NULL;
+}
+
+/* Returns the kernel address of the shared zero page. */
+void *
+frame_zero_page (void)
+{
+  return zero_page;
+}
+
+/* Returns the core map entry for the user pool page FRAME_ADDR. */
+static struct frame *
+frame_lookup (void *frame_addr)
 {
-  const struct frame *f = hash_entry (e, struct frame, hash_elem);
+  size_t index = palloc_user_page_index (frame_addr);
+  ASSERT (index < frame_table_size);
 
-  return hash_bytes (&f->frame_addr, sizeof (f->frame_addr));
+  return &frame_table[index];
 }
 
+/* Adds PAGE, which OWNER has just mapped to F, to the frame's
+   reverse map.  The first mapping of a frame puts it on the clock
+   ring.  Must be called with frame_table_lock held. */
+static void
+frame_map (struct frame *f, struct page *page, struct thread *owner)
+{ 
+  bool first = list_empty (&f->mappings);
+
+  page->owner = owner;
+  page->owner->rss_cnt++;
+  page->frame = f;
+  list_push_back (&f->mappings, &page->frame_elem);
+  if (!first)
+    return;
+
+  /* New frames go just behind the hand, so they are the last ones
+     the hand reaches on its current sweep. */
+  if (clock_hand == NULL)
+    {
+      list_push_back (&frame_clock_list, &f->clock_elem);
+      clock_hand = &f->clock_elem;
+    }
+  else
+    list_insert (clock_hand, &f->clock_elem);
+  frame_clock_cnt++;
+}
+
+/* Removes PAGE from the reverse map of F.  If it was the last
+   mapping, takes the frame off the clock ring and out of the page
+   cache and returns true: the frame is then free.  Must be called
+   with frame_table_lock held. */
 static bool
-frame_less (const struct hash_elem *a, const struct hash_elem *b,
-      void *aux UNUSED)
+frame_unmap (struct frame *f, struct page *page)
 {
-  const struct frame *frame_a = hash_entry (a, struct frame, hash_elem);
-  const struct frame *frame_b = hash_entry (b, struct frame, hash_elem);
+  list_remove (&page->frame_elem);
+  page->owner->rss_cnt--;
+  page->owner = NULL;
+  page->frame = NULL;
+  if (!list_empty (&f->mappings))
+    return false;
 
-  return frame_a->frame_addr < frame_b->frame_addr;
+  /* Move the hand off the frame before unlinking it. */
+  if (clock_hand == &f->clock_elem)
+    {
+      clock_hand = list_next (clock_hand);
+      if (clock_hand == list_end (&frame_clock_list))
+        clock_hand = list_begin (&frame_clock_list);
+    }
+  list_remove (&f->clock_elem);
+  if (--frame_clock_cnt == 0)
+    clock_hand = NULL;
+
+  frame_cache_remove (f);
+  frame_ksm_remove (f);
+  return true;
 }
 
+/* Prints frame eviction statistics. */
+void
+frame_print_stats (void)
+{
+  printf ("Frames: %lld evictions (%lld dirty), %lld clock steps\n",
+          eviction_cnt, dirty_eviction_cnt, clock_step_cnt);
+  printf ("Frames: %lld direct reclaims, %lld background reclaims, "
+          "%lld local reclaims\n",
+          direct_reclaim_cnt, background_reclaim_cnt, local_reclaim_cnt);
+  printf ("Frames: %lld page cache hits, %lld frames cached\n",
+          cache_hit_cnt, cache_insert_cnt);
+  printf ("Frames: %lld clean evictions of swapped-in pages\n",
+          swap_cache_drop_cnt);
+  printf ("Frames: %lld frames zeroed while idle, %lld used\n",
+          prezero_cnt, prezero_hit_cnt);
+  printf ("Frames: %lld mmap frames synced, %lld flushed in the background\n",
+          sync_cnt, flush_cnt);
+  printf ("Frames: %lld mmap frames written back in %lld writes\n",
+          write_back_page_cnt, write_back_cnt);
+  printf ("Frames: %lld frames scanned by KSM, %lld merged away, "
+          "%lld pages copied on write\n",
+          ksm_scan_cnt, ksm_merge_cnt, ksm_unmerge_cnt);
+  printf ("Frames: %lld pages shared copy-on-write by fork\n",
+          fork_share_cnt);
+  printf ("Frames: %lld large pages mapped\n", large_page_cnt);
+  printf ("Frames: %lld evictions of locked pages\n", locked_eviction_cnt);
+}
+
+
 /* Getting user frames */
 void *
 frame_allocator_get_user_page(struct page* page, enum palloc_flags flags,
                               bool writable)
 {
-  int iE;
-  lock_acquire(&frame_allocation_lock);
+  return frame_allocator_get (page, flags, writable, true);
+}
+
+/* Like frame_allocator_get_user_page(), but never evicts: returns
+   NULL instead if taking a frame would leave fewer than the pageout
+   low watermark free.  Used for speculative allocations, which must
+   not push other processes' pages out. */
+void *
+frame_allocator_get_free_user_page(struct page* page, enum palloc_flags flags,
+                                   bool writable)
+{
+  return frame_allocator_get (page, flags, writable, false);
+}
+
+/* Allocates a user frame for PAGE and maps it at PAGE's address in
+   the current thread's page directory.  If no frame is free, evicts
+   one if MAY_EVICT is true, otherwise returns NULL.  A process at its
+   resident-set limit evicts one of its own frames instead, if it has
+   one that can go, and otherwise falls back on the global pool; a
+   speculative allocation at the limit just fails.  The frame is only
+   zeroed if FLAGS includes PAL_ZERO; callers that fill it entirely
+   themselves need not pay for that.  PAL_ZERO requests are served
+   from the pre-zeroed pool when it has a frame, and so usually cost
+   no clearing at all.
+
+   PAGE is not marked as in memory, which keeps the frame from being
+   chosen for eviction until the caller has filled it and sets
+   PAGE_IN_MEMORY itself. */
+static void *
+frame_allocator_get (struct page *page, enum palloc_flags flags,
+                     bool writable, bool may_evict)
+{
   void * user_vaddr = page->vaddr;
+  struct thread *cur = thread_current ();
 
   ASSERT(is_user_vaddr(user_vaddr));
 
-  void *kernel_vaddr = palloc_get_page (PAL_USER | flags);
+  bool at_limit = cur->rss_limit != 0 && cur->rss_cnt >= cur->rss_limit;
+  if (!may_evict && (at_limit || frame_free_cnt () <= pageout_low_water))
+    return NULL;
 
-  if (!kernel_vaddr) {
-    frame_allocator_evict_page();
+  void *kernel_vaddr = NULL;
+
+  /* If every frame of the process is locked or busy, local
+     replacement finds nothing and the frame comes from the global
+     pool below instead, taking the process past its limit. */
+  if (at_limit)
+    {
+      kernel_vaddr = frame_allocator_evict_page (cur, false);
+      if (kernel_vaddr != NULL)
+        {
+          local_reclaim_cnt++;
+          if (flags & PAL_ZERO)
+            memset (kernel_vaddr, 0, PGSIZE);
+        }
+    }
+
+  if (!kernel_vaddr && (flags & PAL_ZERO))
+    {
+      kernel_vaddr = frame_zeroed_get ();
+      if (kernel_vaddr != NULL)
+        prezero_hit_cnt++;
+    }
+  if (!kernel_vaddr)
     kernel_vaddr = palloc_get_page (PAL_USER | flags);
-    ASSERT(kernel_vaddr)
-  }
 
-  size_t i;
+  /* Zeroed frames are free frames too, and better used than evicting
+     one. */
+  if (!kernel_vaddr)
+    kernel_vaddr = frame_zeroed_get ();
+
+  if (!kernel_vaddr) {
+    if (!may_evict)
+      return NULL;
+
+    /* Take over the victim's frame directly, so that no other fault
+       can snatch it once it is free. */
+    kernel_vaddr = frame_allocator_evict_page (NULL, true);
+    direct_reclaim_cnt++;
+    if (flags & PAL_ZERO)
+      memset (kernel_vaddr, 0, PGSIZE);
+  }
 
   /* Map the frame used to it's virtual address. */
+  lock_acquire (&frame_table_lock);
   if (!install_page(user_vaddr, kernel_vaddr, writable)) {
     PANIC("Could not install user page %p", user_vaddr);
   }
+  frame_map (frame_lookup (kernel_vaddr), page, cur);
+  lock_release (&frame_table_lock);
+
+  frame_pageout_poke ();
+
+  return kernel_vaddr;
+}
+
+/* Maps a large page of FRAME_LARGE_PAGES zeroed frames at BASE, which
+   must be aligned to the size of a large page, in the running
+   process's page directory.  Each page in the range must have an
+   entry in the supplemental page table already, and none may be
+   mapped.  The frames join the frame table one by one, so that they
+   can be evicted like any other: evicting one splits the large page
+   into ordinary ones first.
+
+   Never evicts: returns NULL instead if a suitably aligned run of
+   free frames cannot be had without leaving fewer than the pageout
+   low watermark free, or if it would take the process past its
+   resident-set limit.  As in frame_allocator_get(), the pages are not
+   marked as in memory. */
+void *
+frame_allocator_get_large_page (void *base, bool writable)
+{
+  struct thread *cur = thread_current ();
+  uint8_t *kernel_vaddr;
+  void *pt;
+  size_t i;
 
-  frame_map (kernel_vaddr, page, writable);
+  ASSERT (large_pages);
 
-  lock_release(&frame_allocation_lock);
+  if ((cur->rss_limit != 0
+       && cur->rss_cnt + FRAME_LARGE_PAGES > cur->rss_limit)
+      || frame_free_cnt () < FRAME_LARGE_PAGES + pageout_low_water)
+    return NULL;
+
+  /* The page table the large page will be split into is allocated
+     now, because splits happen where allocating is not possible. */
+  pt = palloc_get_page (0);
+  if (pt == NULL)
+    return NULL;
+  kernel_vaddr = palloc_get_aligned (PAL_USER | PAL_ZERO, FRAME_LARGE_PAGES);
+  if (kernel_vaddr == NULL)
+    {
+      palloc_free_page (pt);
+      return NULL;
+    }
+
+  lock_acquire (&frame_table_lock);
+  if (!pagedir_set_large_page (cur->pagedir, base, kernel_vaddr, pt,
+                               writable))
+    {
+      lock_release (&frame_table_lock);
+      palloc_free_multiple (kernel_vaddr, FRAME_LARGE_PAGES);
+      palloc_free_page (pt);
+      return NULL;
+    }
+  for (i = 0; i < FRAME_LARGE_PAGES; i++)
+    {
+      struct page *page = supplemental_lookup_page (cur,
+                                                    (uint8_t *) base
+                                                    + i * PGSIZE);
+      ASSERT (page != NULL && page->frame == NULL);
+      frame_map (frame_lookup (kernel_vaddr + i * PGSIZE), page, cur);
+    }
+  large_page_cnt++;
+  lock_release (&frame_table_lock);
 
-  memset(kernel_vaddr, 0, PGSIZE);
+  frame_pageout_poke ();
 
   return kernel_vaddr;
 }
 
+/* Releases PAGE's mapping of its frame.  The frame itself is freed
+   once no other page maps it.  If the frame is being evicted, waits
+   for that to finish, after which there is nothing left to do. */
 void
-frame_allocator_free_user_page(void* kernel_vaddr, bool is_locked)
+frame_allocator_free_user_page(struct page *page)
 {
-  if (!is_locked)
-    lock_acquire (&frame_allocation_lock);
-  
-  palloc_free_page (kernel_vaddr);
+  lock_acquire (&frame_table_lock);
+  while (page->frame != NULL && page->frame->busy)
+    cond_wait (&frame_unbusy, &frame_table_lock);
 
-  struct frame lookup;
-  lookup.frame_addr = kernel_vaddr;
+  if (page->frame != NULL)
+    frame_allocator_release_page (page);
+  lock_release (&frame_table_lock);
+}
 
-  struct hash_elem *e = hash_find (&frame_table, &lookup.hash_elem);
-  if (!e)
-    PANIC("Frame doesn't exist in frame table.");
+/* Like frame_allocator_free_user_page(), but if PAGE is a memory-
+   mapped page its owner has written to, first writes it back to its
+   file.  The frame is kept busy during the write, so that it cannot
+   be evicted or reused under it. */
+void
+frame_allocator_write_back_user_page (struct page *page)
+{
+  struct frame *f;
+  bool dirty;
+
+  lock_acquire (&frame_table_lock);
+  while (page->frame != NULL && page->frame->busy)
+    cond_wait (&frame_unbusy, &frame_table_lock);
 
-  struct frame *f = hash_entry (e, struct frame, hash_elem);
-  if (!f)
-    PANIC ("Could not load frame info from frame table");
+  f = page->frame;
+  if (f == NULL)
+    {
+      lock_release (&frame_table_lock);
+      return;
+    }
 
+  dirty = (page->page_status & PAGE_MEMORY_MAPPED)
+          && pagedir_is_dirty (page->owner->pagedir, page->vaddr);
+  if (dirty)
+    frame_write_back (f);
 
-  f->page->page_status &= ~PAGE_IN_MEMORY;
+  frame_allocator_release_page (page);
+  lock_release (&frame_table_lock);
+}
 
-  tid_t thread_id = f->owner_id;
-  struct thread* t = thread_lookup(thread_id);
-  if(!t)
-    PANIC("Corruption of frame table");
+/* Prepares PAGE, a memory-mapped page of the running process, to be
+   written back to its file straight from its user address.  If PAGE
+   is resident and its owner has written to it, clears its dirty bit,
+   marks its frame busy and returns true; the caller then writes it
+   and calls frame_end_write_back().  Returns false for a page with
+   nothing to write, so clean pages never reach the file system. */
+bool
+frame_begin_write_back (struct page *page)
+{
+  bool dirty = false;
 
-  pagedir_clear_page (t->pagedir, f->page->vaddr);
-  frame_unmap (kernel_vaddr);  
-  free(f);
+  lock_acquire (&frame_table_lock);
+  while (page->frame != NULL && page->frame->busy)
+    cond_wait (&frame_unbusy, &frame_table_lock);
 
-  if (!is_locked)
-    lock_release (&frame_allocation_lock);
+  if (page->frame != NULL && (page->page_status & PAGE_MEMORY_MAPPED)
+      && pagedir_is_dirty (page->owner->pagedir, page->vaddr))
+    {
+      pagedir_set_dirty (page->owner->pagedir, page->vaddr, false);
+      page->frame->busy = true;
+      dirty = true;
+    }
+  lock_release (&frame_table_lock);
+
+  return dirty;
 }
 
-static void *
-frame_allocator_evict_page(void)
+/* Ends the write back of the CNT pages in PAGES, each prepared by
+   frame_begin_write_back() and all written by a single write. */
+void
+frame_end_write_back (struct page **pages, size_t cnt)
+{
+  size_t i;
+
+  lock_acquire (&frame_table_lock);
+  for (i = 0; i < cnt; i++)
+    pages[i]->frame->busy = false;
+  write_back_cnt++;
+  write_back_page_cnt += cnt;
+  cond_broadcast (&frame_unbusy, &frame_table_lock);
+  lock_release (&frame_table_lock);
+}
+
+/* Waits until PAGE is not in the middle of being evicted.  Page
+   faults call this first, since a page loses its mapping as soon as
+   eviction starts, well before its contents are safely saved. */
+void
+frame_wait_page (struct page *page)
+{
+  lock_acquire (&frame_table_lock);
+  while (page->frame != NULL && page->frame->busy)
+    cond_wait (&frame_unbusy, &frame_table_lock);
+  lock_release (&frame_table_lock);
+}
+
+/* Gives PAGE, a page of the running process merged with others by
+   KSM or shared by fork(), a private copy of its frame, for a write
+   fault on it.  If PAGE has been left the only mapping of the frame,
+   it just becomes writable again.  Either way the page keeps its
+   dirty bit.  The shared frame is kept busy while it is copied, so
+   that it cannot be evicted or freed under the copy. */
+void
+frame_unmerge_page (struct page *page)
+{
+  struct frame *f;
+  void *kernel_vaddr;
+  uint32_t *pd = thread_current ()->pagedir;
+  bool dirty;
+
+  lock_acquire (&frame_table_lock);
+  while (page->frame != NULL && page->frame->busy)
+    cond_wait (&frame_unbusy, &frame_table_lock);
+
+  /* If the page was evicted meanwhile, the retried access faults it
+     back in as a private page. */
+  f = page->frame;
+  if (f == NULL || !(page->page_status & PAGE_MERGED))
+    {
+      lock_release (&frame_table_lock);
+      return;
+    }
+
+  /* The dirty bit says whether the page's swap slot, if any, still
+     holds its contents, so it carries over to the new mapping. */
+  dirty = pagedir_is_dirty (pd, page->vaddr);
+  if (list_size (&f->mappings) == 1)
+    {
+      pagedir_clear_page (pd, page->vaddr);
+      pagedir_set_page (pd, page->vaddr, f->frame_addr, page->writable);
+      pagedir_set_dirty (pd, page->vaddr, dirty);
+      page->page_status &= ~PAGE_MERGED;
+      lock_release (&frame_table_lock);
+      return;
+    }
+
+  f->busy = true;
+  page->page_status &= ~(PAGE_IN_MEMORY | PAGE_MERGED);
+  pagedir_clear_page (pd, page->vaddr);
+  frame_unmap (f, page);
+  lock_release (&frame_table_lock);
+
+  kernel_vaddr = frame_allocator_get_user_page (page, 0, page->writable);
+  memcpy (kernel_vaddr, f->frame_addr, PGSIZE);
+  pagedir_set_dirty (pd, page->vaddr, dirty);
+  page->page_status |= PAGE_IN_MEMORY;
+  ksm_unmerge_cnt++;
+
+  lock_acquire (&frame_table_lock);
+  f->busy = false;
+  cond_broadcast (&frame_unbusy, &frame_table_lock);
+  lock_release (&frame_table_lock);
+}
+
+/* Maps the frame of PAGE, a page of the process forking the running
+   one, at the address of CHILD, the same page of the running process.
+   Every mapping of the frame is made read-only and marked
+   PAGE_MERGED, so the first write to it through either process copies
+   it, just as for a frame merged by KSM.  CHILD gets no swap slot:
+   PAGE's slot stays PAGE's, and eviction saves a merged frame once per
+   page anyway.
+
+   Returns false, without touching CHILD, if PAGE is not resident, or
+   if its frame is memory-mapped or in the page cache; such pages are
+   found again through the child's regions when it faults on them.  A
+   memory-mapped frame outside the cache is written back to its file
+   first if it has been modified, since that is where the child will
+   read it from. */
+bool
+frame_share_page (struct page *page, struct page *child)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  struct frame *f;
+  bool dirty;
+
+  lock_acquire (&frame_table_lock);
+  while (page->frame != NULL && page->frame->busy)
+    cond_wait (&frame_unbusy, &frame_table_lock);
+
+  f = page->frame;
+  if (f == NULL || f->cached || !(page->page_status & PAGE_IN_MEMORY)
+      || (page->page_status & PAGE_MEMORY_MAPPED))
+    {
+      if (f != NULL && !f->cached
+          && (page->page_status & PAGE_MEMORY_MAPPED) && frame_sync (f))
+        sync_cnt++;
+      lock_release (&frame_table_lock);
+      return false;
+    }
+
+  /* A modified page of the executable must go to swap rather than be
+     dropped when the child's mapping is evicted too, so that mapping
+     inherits the dirty bit. */
+  dirty = pagedir_is_dirty (page->owner->pagedir, page->vaddr);
+  if (!pagedir_set_page (cur->pagedir, child->vaddr, f->frame_addr, false))
+    {
+      lock_release (&frame_table_lock);
+      return false;
+    }
+  pagedir_set_dirty (cur->pagedir, child->vaddr, dirty);
+
+  old_level = intr_disable ();
+  frame_ksm_protect (f);
+  intr_set_level (old_level);
+
+  child->page_status = page->page_status;
+  child->swap_slot = SWAP_SLOT_NONE;
+  frame_map (f, child, cur);
+  fork_share_cnt++;
+  lock_release (&frame_table_lock);
+
+  return true;
+}
+
+/* Reserves CNT more locked pages for the running process, for
+   mlock().  Fails if that would take the process past
+   FRAME_LOCKED_PROCESS_MAX locked pages or the system past half of
+   the user pool.  Each reserved page is then locked with
+   frame_lock_page(). */
+bool
+frame_lock_reserve (size_t cnt)
 {
-  struct frame * f = frame_allocator_choose_eviction_frame();
+  struct thread *t = thread_current ();
+  bool reserved = false;
+
+  lock_acquire (&frame_table_lock);
+  if (t->locked_page_cnt + cnt <= FRAME_LOCKED_PROCESS_MAX
+      && locked_cnt + cnt <= locked_max)
+    {
+      t->locked_page_cnt += cnt;
+      locked_cnt += cnt;
+      reserved = true;
+    }
+  lock_release (&frame_table_lock);
 
-  frame_allocator_save_frame (f);
-  frame_allocator_free_user_page(f->frame_addr, true);
+  return reserved;
 }
 
+/* Locks PAGE, a page of the running process, in memory.  Its frame
+   is never chosen for eviction while the page is locked, so once it
+   has been faulted in it stays resident. */
+void
+frame_lock_page (struct page *page)
+{
+  lock_acquire (&frame_table_lock);
+  ASSERT (!page->locked);
+  page->locked = true;
+  lock_release (&frame_table_lock);
+}
+
+/* Unlocks PAGE, a page of the running process, if it is locked,
+   returning its reservation.  Called for munlock() and whenever a
+   page is destroyed. */
+void
+frame_unlock_page (struct page *page)
+{
+  lock_acquire (&frame_table_lock);
+  if (page->locked)
+    {
+      page->locked = false;
+      thread_current ()->locked_page_cnt--;
+      locked_cnt--;
+    }
+  lock_release (&frame_table_lock);
+}
+
+/* Evicts every frame that T alone maps, as far as possible, and
+   returns how many were evicted.  Used when T is deactivated by load
+   control, so that the processes still running get its memory. */
+size_t
+frame_evict_process (struct thread *t)
+{
+  void *kernel_vaddr;
+  size_t cnt = 0;
+
+  while ((kernel_vaddr = frame_allocator_evict_page (t, false)) != NULL)
+    {
+      palloc_free_page (kernel_vaddr);
+      cnt++;
+    }
+  return cnt;
+}
+
+/* Unmaps PAGE from its owner's page directory and from its frame,
+   freeing the frame if PAGE was its last mapping.  Must be called
+   with frame_table_lock held. */
 static void
-frame_allocator_save_frame (struct frame *f)
+frame_allocator_release_page (struct page *page)
 {
-  /* Get the owner thread. */
-  tid_t thread_id = f->owner_id;
-  struct thread* t = thread_lookup (thread_id);
-  if(!t)
-    PANIC("Corruption of frame table");
+  struct frame *f = page->frame;
+
+  ASSERT (f != NULL && !f->busy);
 
-  ASSERT(f->page);
+  page->page_status &= ~PAGE_IN_MEMORY;
+  pagedir_clear_page (page->owner->pagedir, page->vaddr);
+
+  if (frame_unmap (f, page))
+    palloc_free_page (f->frame_addr);
+}
 
-  bool dirty_flag = pagedir_is_dirty (t->pagedir, f->page->vaddr);
-  enum page_status status = f->page->page_status;
- 
+/* Evicts a frame, unmapping it from every page that shares it, and
+   returns its kernel address.  The frame is not returned to the
+   allocator: it belongs to the caller.
+
+   Only choosing the victim and updating its pages take
+   frame_table_lock.  In between, the frame is marked busy and saved
+   with no lock held, so other faults and evictions carry on during
+   the I/O.  If nothing can be evicted right now, waits for that to
+   change if MAY_WAIT is true, otherwise returns NULL.  If OWNER is
+   non-null, only frames mapped by OWNER alone are considered. */
+static void *
+frame_allocator_evict_page (struct thread *owner, bool may_wait)
+{
+  struct pagedir_batch batch;
+  struct frame *f;
+  struct list_elem *e;
+  bool dirty;
+
+  lock_acquire (&frame_table_lock);
+  f = frame_allocator_choose_eviction_frame (owner, may_wait);
+  if (f == NULL)
+    {
+      lock_release (&frame_table_lock);
+      return NULL;
+    }
+  if (frame_is_locked (f))
+    locked_eviction_cnt++;
+
+  /* Take the page away from every sharer before looking at the
+     dirty bits, so that no write can slip in after we look. */
+  pagedir_batch_begin (&batch);
+  for (e = list_begin (&f->mappings); e != list_end (&f->mappings);
+       e = list_next (e))
+    {
+      struct page *page = list_entry (e, struct page, frame_elem);
+      pagedir_clear_page (page->owner->pagedir, page->vaddr);
+    }
+  pagedir_batch_commit (&batch);
+  dirty = frame_is_dirty (f);
+  lock_release (&frame_table_lock);
+
+  frame_allocator_save_frame (f, dirty);
+
+  lock_acquire (&frame_table_lock);
+  while (!list_empty (&f->mappings))
+    {
+      struct page *page = list_entry (list_front (&f->mappings),
+                                      struct page, frame_elem);
+
+      enum page_status status = page->page_status
+                                & ~(PAGE_IN_MEMORY | PAGE_MERGED);
+
+      /* The owner may look at the status without the lock, so it
+         changes in one go.  A modified page of the executable now
+         lives in swap, like an anonymous page. */
+      if ((status & PAGE_FILESYS) && dirty)
+        status = (status & ~PAGE_FILESYS) | PAGE_SWAP;
+      else if (!(status & (PAGE_FILESYS | PAGE_MEMORY_MAPPED)))
+        status |= PAGE_SWAP;
+      page->page_status = status;
+      frame_unmap (f, page);
+    }
+  f->busy = false;
+  cond_broadcast (&frame_unbusy, &frame_table_lock);
+  lock_release (&frame_table_lock);
+
+  return f->frame_addr;
+}
+
+/* Saves the contents of F, which is busy and unmapped, wherever its
+   page will be read back from.  DIRTY is true if any sharer wrote to
+   the frame.  Called without frame_table_lock: the busy flag keeps
+   the reverse map from changing. */
+static void
+frame_allocator_save_frame (struct frame *f, bool dirty_flag)
+{
+  struct page *page = list_entry (list_front (&f->mappings),
+                                  struct page, frame_elem);
+  enum page_status status = page->page_status;
+
+  eviction_cnt++;
+  if (!frame_is_clean (f))
+    dirty_eviction_cnt++;
 
   if ((status & PAGE_MEMORY_MAPPED) && dirty_flag)
   {
-      struct page_mmap_info *mmap_info = (struct page_mmap_info *)f->page->aux;
-      struct mmap_mapping *m = mmap_get_mapping (&t->mmap_table, mmap_info->mapid);
-      
-      mmap_write_back_data (m, f->frame_addr, mmap_info->offset, mmap_info->length);
-  } else if (!(f->page->page_status & PAGE_FILESYS)) {  
-    // Allocate some Swap memory
-    struct swap_entry *s = swap_alloc();
-    if (!s) {
-      PANIC("Frame Eviction: No Swap Memory left!");
-    }
-
-    /* Set the page status to swap. */
-    f->page->page_status |= PAGE_SWAP;
-    f->page->page_status &= ~(PAGE_IN_MEMORY);
-    f->page->aux = s;
-
-    /* Save the data into the swap slot. */
-    swap_save(s, (void*)f->frame_addr);
+      off_t offset;
+      size_t length;
+
+      region_page_location (page->region, page->vaddr, &offset, &length);
+      mmap_write_back_data (page->region->file, f->frame_addr, offset, length);
+  } else if (!(status & (PAGE_FILESYS | PAGE_MEMORY_MAPPED))
+             || ((status & PAGE_FILESYS) && dirty_flag)) {
+    /* Anonymous frames and modified frames of the executable are
+       never cached, so they are only shared if KSM merged them or
+       fork() shared them, in which case every page gets a copy in a
+       swap slot of its own.  The executable itself is never written. */
+    struct list_elem *e;
+
+    for (e = list_begin (&f->mappings); e != list_end (&f->mappings);
+         e = list_next (e))
+      frame_save_anonymous (f, list_entry (e, struct page, frame_elem),
+                            dirty_flag);
   } 
 }
 
-struct frame *
-frame_allocator_choose_eviction_frame (void)
+/* Saves anonymous PAGE, whose contents are in frame F, to swap.
+   DIRTY is true if any sharer of F wrote to it. */
+static void
+frame_save_anonymous (struct frame *f, struct page *page, bool dirty)
 {
-  struct hash_iterator i;
-  struct thread *t;
-  struct frame * eviction_candidate;
-  int32_t least_used = 0;
-  bool dirty_candidate = true;
-  bool accessed_candidate = true;
-  bool dirty;
-  bool accessed;
-
-  // We aim to use pseudo LRU replacement.
-  // When we choose to evict, find the oldest page which hasn't
-  // been accessed since the last eviction. We do
-  // this by choosing the page which has the greatest 
-  // unused_count, which increments when it is unused in this 
-  // algorithm.
-  lock_acquire (&frame_table_lock);
-  hash_first (&i, &frame_table);
-  // Iterate through the frame table.
-  while(hash_next (&i)) {
-    // Get the frame that it is equivalent to
-    struct frame *f = hash_entry (hash_cur (&i), struct frame, hash_elem);
-    // Get the owning thread
-    t = thread_lookup(f->owner_id);
-    dirty = pagedir_is_dirty(t->pagedir, f->frame_addr);
-    accessed = pagedir_is_accessed(t->pagedir, f->frame_addr);
-    // If it is accessed, set is as not accessed and move on
-
-    if (accessed) {
-      if (!accessed_candidate) {
-        f->unused_count = 0;
+  struct thread *t = page->owner;
+
+  /* A page swapped in earlier keeps its slot.  If it has not been
+     written since, the slot still holds its contents and there is
+     nothing to save; otherwise the slot is simply rewritten. */
+  bool write_needed = page->swap_slot == SWAP_SLOT_NONE || dirty;
+  if (page->swap_slot == SWAP_SLOT_NONE)
+    {
+      /* Keep runs of neighbouring pages in neighbouring slots. */
+      if (page->vaddr == t->swap_cluster_next)
+        page->swap_slot = swap_alloc_near (t->swap_cluster_slot);
+      else
+        page->swap_slot = swap_alloc();
+      t->swap_cluster_next = (uint8_t *) page->vaddr + PGSIZE;
+      t->swap_cluster_slot = page->swap_slot + 1;
+    }
+
+  /* Save the data into the swap slot.  The page is marked as
+     swapped out once the write is done. */
+  if (write_needed)
+    swap_save(page->swap_slot, f->frame_addr);
+  else
+    swap_cache_drop_cnt++;
+}
+
+/* Returns the frame under the clock hand and moves the hand on to
+   the next frame, wrapping around at the end of the ring.  Must be
+   called with frame_table_lock held and a non-empty ring. */
+static struct frame *
+frame_clock_advance (void)
+{
+  struct frame *f;
+
+  ASSERT (clock_hand != NULL);
+
+  f = list_entry (clock_hand, struct frame, clock_elem);
+  clock_hand = list_next (clock_hand);
+  if (clock_hand == list_end (&frame_clock_list))
+    clock_hand = list_begin (&frame_clock_list);
+
+  clock_step_cnt++;
+  return f;
+}
+
+/* Returns true if F may be chosen as an eviction victim.  A busy
+   frame is already being evicted.  A page not yet marked as in memory
+   is still being read in, or is about to be marked so by a fault that
+   has just mapped a cached frame. */
+static bool
+frame_is_evictable (struct frame *f)
+{
+  struct list_elem *e;
+
+  if (f->busy)
+    return false;
+
+  for (e = list_begin (&f->mappings); e != list_end (&f->mappings);
+       e = list_next (e))
+    {
+      struct page *page = list_entry (e, struct page, frame_elem);
+
+      if (!(page->page_status & PAGE_IN_MEMORY))
+        return false;
+    }
+
+  return true;
+}
+
+/* Returns true if any page mapping F is locked by mlock(). */
+static bool
+frame_is_locked (struct frame *f)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&f->mappings); e != list_end (&f->mappings);
+       e = list_next (e))
+    if (list_entry (e, struct page, frame_elem)->locked)
+      return true;
+
+  return false;
+}
+
+/* Returns true if every page mapping F belongs to T. */
+static bool
+frame_is_owned_by (struct frame *f, struct thread *t)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&f->mappings); e != list_end (&f->mappings);
+       e = list_next (e))
+    if (list_entry (e, struct page, frame_elem)->owner != t)
+      return false;
+
+  return true;
+}
+
+/* Returns true if F can be evicted without writing anything out:
+   an unmodified page of a memory-mapped file or of the executable,
+   or an unmodified page that was swapped in and still has its swap
+   slot.  Other anonymous pages always have to go to swap. */
+static bool
+frame_is_clean (struct frame *f)
+{
+  struct page *page = list_entry (list_front (&f->mappings),
+                                  struct page, frame_elem);
+  struct list_elem *e;
+
+  if (page->page_status & (PAGE_FILESYS | PAGE_MEMORY_MAPPED))
+    return !frame_is_dirty (f);
+
+  /* Each page of a merged anonymous frame needs a slot of its own. */
+  for (e = list_begin (&f->mappings); e != list_end (&f->mappings);
+       e = list_next (e))
+    if (list_entry (e, struct page, frame_elem)->swap_slot == SWAP_SLOT_NONE)
+      return false;
+
+  return !frame_is_dirty (f);
+}
+
+/* Returns true if any page mapping F has been written through. */
+static bool
+frame_is_dirty (struct frame *f)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&f->mappings); e != list_end (&f->mappings);
+       e = list_next (e))
+    {
+      struct page *page = list_entry (e, struct page, frame_elem);
+      if (pagedir_is_dirty (page->owner->pagedir, page->vaddr))
+        return true;
+    }
+
+  return false;
+}
+
+/* Returns true if any page mapping F has been accessed, and clears
+   the accessed bit of every mapping.  Accesses to regions advised as
+   MADV_SEQUENTIAL do not count: a scan rarely comes back to the pages
+   behind it, so they should go before the rest of the working set. */
+static bool
+frame_test_and_clear_accessed (struct frame *f)
+{
+  struct list_elem *e;
+  bool accessed = false;
+
+  for (e = list_begin (&f->mappings); e != list_end (&f->mappings);
+       e = list_next (e))
+    {
+      struct page *page = list_entry (e, struct page, frame_elem);
+      uint32_t *pd = page->owner->pagedir;
+
+      if (pagedir_is_accessed (pd, page->vaddr))
+        {
+          pagedir_set_accessed (pd, page->vaddr, false);
+          if (page->region == NULL
+              || page->region->advice != MADV_SEQUENTIAL)
+            accessed = true;
+        }
+    }
+
+  return accessed;
+}
+
+/* Chooses a frame to evict using WSClock.
+
+   The hand sweeps the ring of resident frames.  A frame whose
+   accessed bit is set gets a second chance: the bit is cleared and
+   the hand moves on.  The first unreferenced frame that is clean is
+   taken immediately.  Unreferenced frames that would need a write
+   are passed over but remembered, and the first of them is used if
+   two full sweeps find nothing clean.  Since every sweep clears the
+   accessed bits it passes, the hand normally stops after examining
+   only a few frames.  A shared frame counts as referenced if any of
+   its mappings is.
+
+   If OWNER is non-null, the hand passes over frames that are not
+   mapped by OWNER alone without touching their accessed bits, and
+   NULL is returned rather than waiting if none of OWNER's frames can
+   be evicted.  NULL is also returned if MAY_WAIT is false and nothing
+   can be evicted, even if no frame is resident at all. */
+static struct frame *
+frame_allocator_choose_eviction_frame (struct thread *owner, bool may_wait)
+{
+  struct frame *victim = NULL;
+  struct frame *dirty_candidate = NULL;
+  size_t step;
+
+  ASSERT (lock_held_by_current_thread (&frame_table_lock));
+
+  for (;;)
+    {
+      /* Only a caller that would otherwise wait forever gives up
+         the kernel for an empty ring. */
+      if (frame_clock_cnt == 0)
+        {
+          if (!may_wait || owner != NULL)
+            return NULL;
+          PANIC ("Frame Eviction: no resident frames to evict");
+        }
+
+      for (step = 0; step < 2 * frame_clock_cnt && victim == NULL; step++)
+        {
+          struct frame *f = frame_clock_advance ();
+
+          if (!frame_is_evictable (f) || frame_is_locked (f)
+              || (owner != NULL && !frame_is_owned_by (f, owner)))
+            continue;
+
+          if (frame_test_and_clear_accessed (f))
+            continue;
+
+          if (frame_is_clean (f))
+            victim = f;
+          else if (dirty_candidate == NULL)
+            dirty_candidate = f;
+        }
+
+      if (victim == NULL)
+        victim = dirty_candidate;
+      if (victim != NULL)
         break;
-      }
+      if (!may_wait || owner != NULL)
+        return NULL;
+
+      /* Everything is busy being evicted or filled by someone else.
+         Let them get on with it and look again. */
+      lock_release (&frame_table_lock);
+      thread_yield ();
+      lock_acquire (&frame_table_lock);
     }
-    else
-     f->unused_count++;
 
-    if (dirty) {
-      if (!dirty_candidate) {
-        f->unused_count = 0;
+  victim->busy = true;
+  return victim;
+}
+
+/* Maps the cached frame holding bytes OFFSET...OFFSET+LENGTH of INODE
+   at PAGE's address in the current thread's page directory, and
+   returns it.  Returns NULL if no such frame is cached, in which case
+   the caller should read the page into a frame of its own and offer
+   it with frame_cache_insert().  Sharers must agree on WRITABLE: a
+   writable frame is shared in the sense of a MAP_SHARED mapping. */
+void *
+frame_cache_get_user_page (struct page *page, struct inode *inode,
+                           off_t offset, size_t length, bool writable)
+{
+  void *kernel_vaddr = NULL;
+  struct frame *f;
+
+  ASSERT (is_user_vaddr (page->vaddr));
+
+  lock_acquire (&frame_table_lock);
+  for (;;)
+    {
+      f = frame_cache_lookup (inode_get_inumber (inode), offset);
+      if (f == NULL || f->length != length || f->writable != writable)
         break;
-      }
+
+      /* A frame being evicted may be writing its data back to the
+         file, so neither it nor the file can be trusted until it is
+         done. */
+      if (f->busy)
+        {
+          cond_wait (&frame_unbusy, &frame_table_lock);
+          continue;
+        }
+
+      kernel_vaddr = f->frame_addr;
+      if (!install_page (page->vaddr, kernel_vaddr, writable))
+        PANIC ("Could not install user page %p", page->vaddr);
+      frame_map (f, page, thread_current ());
+      cache_hit_cnt++;
+      break;
     }
-    else
-     f->unused_count++;
+  lock_release (&frame_table_lock);
+
+  return kernel_vaddr;
+}
+
+/* Enters the frame at KERNEL_VADDR, which has just been filled with
+   bytes OFFSET...OFFSET+LENGTH of INODE, in the page cache.  Does
+   nothing if another frame already caches that page, as happens when
+   two processes fault on it at once. */
+void
+frame_cache_insert (void *kernel_vaddr, struct inode *inode,
+                    off_t offset, size_t length, bool writable)
+{
+  struct frame *f = frame_lookup (kernel_vaddr);
 
-    if (++f->unused_count > least_used && !(f->page->page_status & PAGE_FILESYS)) {
-      eviction_candidate = f;
-      dirty_candidate = dirty;
-      accessed_candidate = accessed;  
-      least_used = f->unused_count;
+  lock_acquire (&frame_table_lock);
+  ASSERT (!list_empty (&f->mappings));
+  if (!f->cached)
+    {
+      f->sector = inode_get_inumber (inode);
+      f->offset = offset;
+      f->length = length;
+      f->writable = writable;
+      if (hash_insert (&frame_cache, &f->cache_elem) == NULL)
+        {
+          f->cached = true;
+          cache_insert_cnt++;
+        }
     }
-  }
+  lock_release (&frame_table_lock);
+}
+
+/* Copies the LENGTH bytes that write() has just written from BUFFER,
+   a kernel address, to INODE at OFFSET into the cached frames of the
+   pages they overlap, so that every process mapping those frames sees
+   the file's new contents.  Must be called with the file system lock
+   held, as for the write itself, so that no fault can read the old
+   contents from the file and cache them in between.
+
+   Busy frames are updated too, without waiting for them.  Anything
+   writing one back to the file needs the file system lock to do so,
+   and so writes the new bytes, and a frame being evicted stays in the
+   cache until frame_table_lock is released.  The key of a cached frame
+   is never changed. */
+void
+frame_cache_update (struct inode *inode, off_t offset, const void *buffer,
+                    off_t length)
+{
+  block_sector_t sector = inode_get_inumber (inode);
+  const uint8_t *src = buffer;
+  off_t ofs = offset;
+
+  if (length <= 0)
+    return;
+
+  lock_acquire (&frame_table_lock);
+  while (ofs < offset + length && !hash_empty (&frame_cache))
+    {
+      size_t page_ofs = ofs % PGSIZE;
+      size_t chunk = PGSIZE - page_ofs;
+      struct frame *f;
 
-  eviction_candidate->unused_count = 0;
+      if (chunk > (size_t) (offset + length - ofs))
+        chunk = offset + length - ofs;
+
+      f = frame_cache_lookup (sector, ofs - page_ofs);
+      if (f != NULL)
+        {
+          memcpy ((uint8_t *) f->frame_addr + page_ofs, src, chunk);
+
+          /* The length is part of what a frame is cached under, and
+             its mappers still look it up by the old one, so a frame
+             that now holds more file data leaves the cache instead.
+             Later faults read the page afresh. */
+          if (f->length < page_ofs + chunk)
+            frame_cache_remove (f);
+        }
+      ofs += chunk;
+      src += chunk;
+    }
   lock_release (&frame_table_lock);
-  return eviction_candidate;
-}
\ No newline at end of file
+}
+
+/* Returns the cached frame holding the page at OFFSET in the file
+   whose inode is at SECTOR, or NULL. */
+static struct frame *
+frame_cache_lookup (block_sector_t sector, off_t offset)
+{
+  struct frame key;
+  struct hash_elem *e;
+
+  key.sector = sector;
+  key.offset = offset;
+  e = hash_find (&frame_cache, &key.cache_elem);
+
+  return e != NULL ? hash_entry (e, struct frame, cache_elem) : NULL;
+}
+
+/* Takes F out of the page cache, if it is in it. */
+static void
+frame_cache_remove (struct frame *f)
+{
+  if (f->cached)
+    {
+      hash_delete (&frame_cache, &f->cache_elem);
+      f->cached = false;
+    }
+}
+
+static unsigned
+frame_cache_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct frame *f = hash_entry (e, struct frame, cache_elem);
+
+  return hash_int (f->sector) ^ hash_int (f->offset);
+}
+
+static bool
+frame_cache_less (const struct hash_elem *a, const struct hash_elem *b,
+                  void *aux UNUSED)
+{
+  const struct frame *fa = hash_entry (a, struct frame, cache_elem);
+  const struct frame *fb = hash_entry (b, struct frame, cache_elem);
+
+  if (fa->sector != fb->sector)
+    return fa->sector < fb->sector;
+  return fa->offset < fb->offset;
+}
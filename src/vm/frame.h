@@ -1,26 +1,97 @@
 #ifndef VM_FRAME_H
 #define VM_FRAME_H
 #include <hash.h>
+#include <list.h>
+#include "devices/block.h"
+#include "filesys/off_t.h"
 #include "vm/page.h"
 #include "threads/palloc.h"
 
+struct inode;
 
+/* An entry in the core map.  There is exactly one of these for every
+   page of the user pool, found by the page's index within the pool,
+   so no allocation or lookup structure is needed on the fault path.
 
-struct hash frame_table;
+   A frame holding a page of a file may be entered in the page cache,
+   after which every process faulting on the same page of the same
+   file maps this frame instead of reading its own copy.  The pages
+   currently mapping the frame form its reverse map.
 
+   A frame is busy while it is being evicted.  Its pages are already
+   unmapped, but their contents are still being saved, so faults on
+   them must wait; see frame_wait_page(). */
 struct frame {
-	struct hash_elem hash_elem;		/* Used to store the frame in the frame table. */
-	int32_t frame_addr;				/* The address of the frame in memory.         */
-	struct page *page;				/* Stores the page mapped into this frame      */
-	tid_t owner_id;					/* Stores the tid of the owning thread    */
-	int32_t unused_count;			/*Represents how many times the frame was not evicted*/
+	struct list_elem clock_elem;	/* Position of the frame on the clock ring.     */
+	void *frame_addr;				/* The address of the frame in memory.         */
+	struct list mappings;			/* The pages mapping this frame, linked through
+									   their frame_elem.  Empty if the frame is
+									   free.                                       */
+
+	struct hash_elem cache_elem;	/* Element in the page cache.                  */
+	bool cached;					/* True if the frame is in the page cache.     */
+	block_sector_t sector;			/* Inode sector of the cached file.            */
+	off_t offset;					/* Offset of the cached page within the file.  */
+	size_t length;					/* Bytes of file data in the cached page.      */
+	bool writable;					/* Whether sharers map the frame writable.     */
+
+	bool busy;						/* True while the frame is being evicted.      */
+
+	struct hash_elem ksm_elem;		/* Element in the KSM table.                   */
+	bool ksm_listed;				/* True if the frame is in the KSM table.      */
+	unsigned ksm_hash;				/* Hash of its contents when last scanned.     */
 };
 
+/* Passed to frame_pageout_init() to pick a watermark scaled to the
+   size of the user pool. */
+#define FRAME_WATERMARK_DEFAULT SIZE_MAX
+
+/* Most pages a single process may lock in memory with mlock(). */
+#define FRAME_LOCKED_PROCESS_MAX 64
+
+/* Smallest resident-set limit a process may have, in pages: enough
+   for any single instruction's code, stack and data to be resident
+   at once. */
+#define FRAME_RSS_MIN 16
+
+/* Frames in a large page, which maps 4 MB at once. */
+#define FRAME_LARGE_PAGES 1024
+
 void frame_table_init(void);
+void frame_pageout_init (size_t low_water, size_t high_water);
+void frame_flusher_init (int interval_ms);
+void frame_rss_init (size_t limit);
+size_t frame_rss_default (void);
+size_t frame_evict_process (struct thread *t);
+void frame_ksm_init (int interval_ms, size_t pages);
+void frame_large_init (void);
+bool frame_large_enabled (void);
+void frame_unmerge_page (struct page *page);
+bool frame_share_page (struct page *page, struct page *child);
+void frame_print_stats (void);
+void *frame_zero_page (void);
+bool frame_prezero (void);
 
 void *frame_allocator_get_user_page(struct page *page, enum palloc_flags flags, bool writable);
-void frame_allocator_free_user_page(void *kernel_vaddr, bool locked);
+void *frame_allocator_get_free_user_page(struct page *page, enum palloc_flags flags, bool writable);
+void *frame_allocator_get_large_page (void *base, bool writable);
+void frame_allocator_free_user_page(struct page *page);
+void frame_allocator_write_back_user_page (struct page *page);
+bool frame_sync_user_page (struct page *page);
+bool frame_begin_write_back (struct page *page);
+void frame_end_write_back (struct page **pages, size_t cnt);
+void frame_wait_page (struct page *page);
+bool frame_lock_reserve (size_t cnt);
+void frame_lock_page (struct page *page);
+void frame_unlock_page (struct page *page);
+
+void *frame_cache_get_user_page (struct page *page, struct inode *inode,
+                                 off_t offset, size_t length, bool writable);
+void frame_cache_insert (void *kernel_vaddr, struct inode *inode,
+                         off_t offset, size_t length, bool writable);
+void frame_cache_update (struct inode *inode, off_t offset, const void *buffer,
+                         off_t length);
 
 
 
-#endif /* vm/frame.h */
\ No newline at end of file
+#endif /* vm/frame.h */
@@ -0,0 +1,237 @@
+#include "vm/load.h"
+
+#include <debug.h>
+#include <list.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "vm/frame.h"
+
+/* Load control.
+
+   When the working sets of the running processes together no longer
+   fit in the user pool, each process spends its time faulting back
+   in pages that another has just pushed out, and throughput
+   collapses.  The controller samples the rate of faults that have to
+   read a page from swap or a file.  Once that has stayed at or above
+   the threshold for LOAD_THRASH_INTERVALS intervals in a row, it
+   deactivates one process: at its next fault from user mode, the
+   process gives up every frame it can and sleeps.  The victim is the
+   process of lowest priority among those that faulted during the last
+   interval, the largest of them on a tie, and at least one process
+   is always left running.  Once the fault rate has dropped to half
+   the threshold, or no process is left running, the process that was
+   deactivated first is reactivated.
+
+   The suspended list and each thread's load_suspended flag are
+   protected by disabling interrupts, so that the controller can set
+   them while it walks the thread list.  Sleeping processes wait on
+   load_resumed, and the flag is only cleared with load_lock held, so
+   no wakeup is lost. */
+
+#define LOAD_INTERVAL_MS 100            /* Sampling interval. */
+#define LOAD_THRASH_INTERVALS 3         /* Intervals of thrashing to act on. */
+
+/* Faults per interval counted as thrashing. */
+static long long thrash_threshold;
+
+/* Faults that read a page in, since boot. */
+static long long fault_cnt;
+
+static struct lock load_lock;
+static struct condition load_resumed;
+
+/* Deactivated processes, in the order they were deactivated. */
+static struct list suspended_list;
+
+/* Statistics. */
+static long long thrash_interval_cnt;   /* # of intervals over the threshold. */
+static long long suspend_cnt;           /* # of processes deactivated. */
+static long long resume_cnt;            /* # of processes reactivated. */
+static long long release_cnt;           /* # of frames given up by them. */
+
+/* Candidates for deactivation, gathered by load_scan(). */
+struct load_scan
+  {
+    size_t active_cnt;                  /* Running user processes. */
+    struct thread *victim;              /* Best candidate, or NULL. */
+  };
+
+static void load_controller (void *aux);
+static void load_scan (struct thread *t, void *scan_);
+static void load_resume_one (void);
+
+/* Starts the load controller, treating FAULTS_PER_SEC faults that
+   read a page in as thrashing.  Does nothing if FAULTS_PER_SEC is 0. */
+void
+load_init (int faults_per_sec)
+{
+  if (faults_per_sec <= 0)
+    return;
+
+  thrash_threshold = (long long) faults_per_sec * LOAD_INTERVAL_MS / 1000;
+  if (thrash_threshold < 1)
+    thrash_threshold = 1;
+
+  lock_init (&load_lock);
+  cond_init (&load_resumed);
+  list_init (&suspended_list);
+  thread_create ("load", PRI_DEFAULT, load_controller, NULL);
+}
+
+/* Counts a fault of the running process that has to read its page
+   in from swap or a file. */
+void
+load_fault (void)
+{
+  fault_cnt++;
+  thread_current ()->load_fault_cnt++;
+}
+
+/* Called on each fault from user mode.  If the running process has
+   been deactivated, evicts every frame it alone maps and sleeps until
+   it is reactivated.  Must not be called with any lock held. */
+void
+load_wait (void)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  bool suspended;
+
+  if (thrash_threshold == 0)
+    return;
+
+  old_level = intr_disable ();
+  suspended = cur->load_suspended;
+  intr_set_level (old_level);
+  if (!suspended)
+    return;
+
+  release_cnt += frame_evict_process (cur);
+
+  lock_acquire (&load_lock);
+  while (cur->load_suspended)
+    cond_wait (&load_resumed, &load_lock);
+  lock_release (&load_lock);
+}
+
+/* Forgets T, which is exiting, if it has been deactivated but has
+   not faulted since. */
+void
+load_exit (struct thread *t)
+{
+  enum intr_level old_level;
+
+  if (thrash_threshold == 0)
+    return;
+
+  old_level = intr_disable ();
+  if (t->load_suspended)
+    {
+      list_remove (&t->load_elem);
+      t->load_suspended = false;
+    }
+  intr_set_level (old_level);
+}
+
+/* Prints load control statistics. */
+void
+load_print_stats (void)
+{
+  printf ("Load: %lld thrashing intervals, %lld processes deactivated, "
+          "%lld reactivated, %lld frames released\n",
+          thrash_interval_cnt, suspend_cnt, resume_cnt, release_cnt);
+}
+
+/* The load controller.  Samples the fault rate every
+   LOAD_INTERVAL_MS milliseconds and deactivates or reactivates a
+   process as described at the top of this file. */
+static void
+load_controller (void *aux UNUSED)
+{
+  long long last_cnt = 0;
+  int streak = 0;
+
+  for (;;)
+    {
+      struct load_scan scan;
+      enum intr_level old_level;
+      long long faults;
+
+      timer_msleep (LOAD_INTERVAL_MS);
+      faults = fault_cnt - last_cnt;
+      last_cnt = fault_cnt;
+
+      scan.active_cnt = 0;
+      scan.victim = NULL;
+      old_level = intr_disable ();
+      thread_foreach (load_scan, &scan);
+
+      if (faults >= thrash_threshold)
+        {
+          thrash_interval_cnt++;
+          if (++streak >= LOAD_THRASH_INTERVALS && scan.active_cnt > 1
+              && scan.victim != NULL)
+            {
+              scan.victim->load_suspended = true;
+              list_push_back (&suspended_list, &scan.victim->load_elem);
+              suspend_cnt++;
+              streak = 0;
+            }
+          intr_set_level (old_level);
+          continue;
+        }
+      intr_set_level (old_level);
+
+      streak = 0;
+      if (faults <= thrash_threshold / 2 || scan.active_cnt == 0)
+        load_resume_one ();
+    }
+}
+
+/* Called for each thread T by load_controller(), with interrupts
+   off.  Takes the fault rate of T over the last interval and, if T is
+   a running user process, counts it and considers it for
+   deactivation. */
+static void
+load_scan (struct thread *t, void *scan_)
+{
+  struct load_scan *scan = scan_;
+  long long faults = t->load_fault_cnt - t->load_fault_last;
+
+  t->load_fault_last = t->load_fault_cnt;
+  if (t->pagedir == NULL || t->load_suspended)
+    return;
+
+  scan->active_cnt++;
+  if (faults == 0)
+    return;
+
+  if (scan->victim == NULL
+      || t->priority < scan->victim->priority
+      || (t->priority == scan->victim->priority
+          && t->rss_cnt > scan->victim->rss_cnt))
+    scan->victim = t;
+}
+
+/* Reactivates the process that was deactivated first, if any. */
+static void
+load_resume_one (void)
+{
+  enum intr_level old_level;
+
+  lock_acquire (&load_lock);
+  old_level = intr_disable ();
+  if (!list_empty (&suspended_list))
+    {
+      struct thread *t = list_entry (list_pop_front (&suspended_list),
+                                     struct thread, load_elem);
+      t->load_suspended = false;
+      resume_cnt++;
+    }
+  intr_set_level (old_level);
+  cond_broadcast (&load_resumed, &load_lock);
+  lock_release (&load_lock);
+}
@@ -0,0 +1,12 @@
+#ifndef VM_LOAD_H
+#define VM_LOAD_H
+
+struct thread;
+
+void load_init (int faults_per_sec);
+void load_fault (void);
+void load_wait (void);
+void load_exit (struct thread *t);
+void load_print_stats (void);
+
+#endif /* vm/load.h */
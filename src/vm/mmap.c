@@ -1,5 +1,19 @@
 #include "vm/mmap.h"
 
+#include "filesys/file.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/process.h"
+#include "vm/frame.h"
+#include "vm/page.h"
+#include "vm/region.h"
+
+/* Most pages mmap_write_back_region() writes with a single write. */
+#define MMAP_WRITE_BACK_MAX 32
+
+static void mmap_write_back_run (struct region *r, struct page **run,
+                                 size_t cnt, off_t offset, size_t length);
+
 struct mmap_mapping *
 mmap_get_mapping (struct hash *mmap_table, mapid_t mapid)
 {
@@ -42,11 +56,74 @@ mmap_table_destroy_func (struct hash_elem *e, void *aux)
   munmap_syscall_with_mapping (mapping, false);
 }
 
+/* Writes LENGTH bytes from SOURCE to FILE at OFFSET.  The write is
+   positional, so it does not disturb the file's current position. */
 void
-mmap_write_back_data (struct mmap_mapping *mapping, void *source, size_t offset, size_t length)
+mmap_write_back_data (struct file *file, void *source, size_t offset, size_t length)
 {
   start_file_system_access ();
-  file_seek (mapping->file, offset);
-  file_write (mapping->file, source, length);
+  file_write_at (file, source, length, offset);
   end_file_system_access ();
-}
\ No newline at end of file
+}
+
+/* Writes every page of region R of the running process that has
+   been written to back to its file, ahead of R being unmapped.  Runs
+   of adjacent dirty pages go out in one write, straight from their
+   user addresses, and clean pages are skipped without taking the file
+   system lock at all.  The frames of a run are kept busy while it is
+   written, so they stay mapped and the copy out of them cannot fault
+   with the file system lock held. */
+void
+mmap_write_back_region (struct region *r)
+{
+  struct hash *supplemental_page_table =
+    &thread_current ()->supplemental_page_table;
+  struct page *run[MMAP_WRITE_BACK_MAX];
+  size_t run_cnt = 0;
+  off_t run_offset = 0;
+  size_t run_length = 0;
+  void *uaddr;
+
+  for (uaddr = r->start; uaddr < r->end; uaddr += PGSIZE)
+    {
+      struct page *page = NULL;
+      off_t offset;
+      size_t length;
+
+      if (!supplemental_entry_exists (supplemental_page_table, uaddr, &page)
+          || !frame_begin_write_back (page))
+        {
+          mmap_write_back_run (r, run, run_cnt, run_offset, run_length);
+          run_cnt = 0;
+          run_length = 0;
+          continue;
+        }
+
+      region_page_location (r, uaddr, &offset, &length);
+      if (run_cnt == 0)
+        run_offset = offset;
+      run[run_cnt++] = page;
+      run_length += length;
+
+      if (run_cnt == MMAP_WRITE_BACK_MAX)
+        {
+          mmap_write_back_run (r, run, run_cnt, run_offset, run_length);
+          run_cnt = 0;
+          run_length = 0;
+        }
+    }
+  mmap_write_back_run (r, run, run_cnt, run_offset, run_length);
+}
+
+/* Writes the CNT adjacent pages in RUN, LENGTH bytes in all, to R's
+   file at OFFSET, then releases their frames. */
+static void
+mmap_write_back_run (struct region *r, struct page **run, size_t cnt,
+                     off_t offset, size_t length)
+{
+  if (cnt == 0)
+    return;
+
+  mmap_write_back_data (r->file, run[0]->vaddr, offset, length);
+  frame_end_write_back (run, cnt);
+}
@@ -3,11 +3,14 @@
 #include "threads/palloc.h"
 #include "threads/malloc.h"
 #include "threads/vaddr.h"
+#include "userprog/pagedir.h"
 #include "vm/frame.h"
+#include "vm/region.h"
 
 static struct page *supplemental_get_page_info (struct hash *supplemental_page_table,
                                                 void *vaddr);
-static void free_user_page(void* upage);
+static void free_user_page(struct page *page);
+static bool supplemental_fork_page (struct thread *t, struct page *page);
   
 void
 supplemental_insert_page_info (struct hash *supplemental_page_table,
@@ -29,58 +32,29 @@ supplemental_get_page_info (struct hash *supplemental_page_table, void *vaddr)
   return hash_entry (e, struct page, hash_elem);
 }
 
-struct page*
-supplemental_create_filesys_page_info (void *vaddr,
-                                       struct page_filesys_info *filesys_info,
-                                       bool writable)
-{
-  struct page *page_info = malloc (sizeof (struct page));
-  if (page_info) {
-    page_info->page_status = PAGE_FILESYS;  
-    page_info->aux = filesys_info;
-    page_info->writable = writable;
-    page_info->vaddr = vaddr;
-  }
-  return page_info;
-}
-
-struct page*
-supplemental_create_mmap_page_info (void *vaddr,
-                                    struct page_mmap_info *mmap_info)
-{
-  struct page *page_info = malloc (sizeof (struct page));
-  if (page_info)
-  { 
-    page_info->page_status = PAGE_MEMORY_MAPPED;
-    page_info->aux = mmap_info;
-    page_info->vaddr = vaddr;
-  }
-  return page_info;
-}
-
-struct page*
-supplemental_create_zero_page_info (void *vaddr)
-{
-  struct page *page_info = malloc (sizeof (struct page));
-  if (page_info) {
-    page_info->page_status = PAGE_ZERO;
-    page_info->aux = NULL;
-    page_info->writable = true;
-    page_info->vaddr = vaddr;
-  }
-  return page_info;
-}
-
-struct page*
-supplemental_create_swap_page (void *vaddr,
-                               struct swap_entry *swap_page)
+/* Creates the page at VADDR of region R, which has no entry yet. */
+static struct page *
+supplemental_create_region_page_info (struct region *r, void *vaddr)
 {
   struct page *page_info = malloc (sizeof (struct page));
   if (page_info) {
-    page_info->page_status = PAGE_SWAP;
-    page_info->aux = (void*)swap_page;
-    page_info->writable = false;
+    off_t offset;
+    size_t length;
+
+    /* Pages of an executable segment past its file data, as in BSS,
+       are plain zero-fill pages. */
+    region_page_location (r, vaddr, &offset, &length);
+    if (r->type == PAGE_FILESYS && length == 0)
+      page_info->page_status = PAGE_ZERO;
+    else
+      page_info->page_status = r->type;
+    page_info->region = r;
+    page_info->swap_slot = SWAP_SLOT_NONE;
+    page_info->writable = r->writable;
     page_info->vaddr = vaddr;
+    page_info->owner = NULL;
+    page_info->frame = NULL;
+    page_info->locked = false;
   }
   return page_info;
 }
@@ -91,21 +65,22 @@ supplemental_create_in_memory_page_info (void *vaddr, bool writable)
   struct page *page_info = malloc (sizeof (struct page));
   if (page_info) {
     page_info->page_status = PAGE_IN_MEMORY;
-    page_info->aux = NULL;
+    page_info->region = NULL;
+    page_info->swap_slot = SWAP_SLOT_NONE;
     page_info->writable = writable;
     page_info->vaddr = vaddr;
+    page_info->owner = NULL;
+    page_info->frame = NULL;
+    page_info->locked = false;
   }
   return page_info;
 }
 
 
 static void 
-free_user_page(void* upage)
+free_user_page(struct page *page)
 {
-  struct thread *t = thread_current();
-  void* kpage = pagedir_get_page(t->pagedir, upage);
-
-  frame_allocator_free_user_page(kpage, false);
+  frame_allocator_free_user_page(page);
 }
 
 void
@@ -154,17 +129,184 @@ supplemental_remove_page_entry (struct hash *supplemental_page_table, void *uadd
     return;
 
   hash_delete (supplemental_page_table, &p.hash_elem);
+  frame_unlock_page (page_info);
   free (page_info);
 }
 
-bool 
-supplemental_is_page_writable (struct hash *supplemental_page_table, void *uaddr)
+/* Returns the page of T's address space at UADDR.  A page of a
+   region that has never been touched has no supplemental page table
+   entry yet, so one is created for it here.  Returns NULL if UADDR is
+   not mapped at all, or if memory is short. */
+struct page *
+supplemental_lookup_page (struct thread *t, void *uaddr)
 {
-  struct page *p = supplemental_get_page_info (supplemental_page_table, uaddr);
-  if (!p)
-    PANIC ("Could not determine if page %p is writable, as it is not mapped.", p);
+  struct page *p = supplemental_get_page_info (&t->supplemental_page_table,
+                                               uaddr);
+  if (p != NULL)
+    return p;
+
+  struct region *r = region_find (&t->regions, uaddr);
+  if (r == NULL)
+    return NULL;
+
+  p = supplemental_create_region_page_info (r, pg_round_down (uaddr));
+  if (p != NULL)
+    supplemental_insert_page_info (&t->supplemental_page_table, p);
+  return p;
+}
+
+/* Returns true if UADDR is mapped in T's address space, either by a
+   page of its own or as part of a region, without creating a page
+   for it.  If WRITABLE is non-null, stores in it whether the page may
+   be written. */
+bool
+supplemental_is_mapped (struct thread *t, void *uaddr, bool *writable)
+{
+  struct page *p = supplemental_get_page_info (&t->supplemental_page_table,
+                                               uaddr);
+  if (p != NULL)
+    {
+      if (writable)
+        *writable = p->writable;
+      return true;
+    }
+
+  struct region *r = region_find (&t->regions, uaddr);
+  if (r == NULL)
+    return false;
+
+  if (writable)
+    *writable = r->writable;
+  return true;
+}
+
+/* Drops PAGE of thread T, as for madvise (MADV_DONTNEED).  Its frame
+   and swap slot are freed straight away, and its next access finds it
+   as if it had never been touched: zero-filled, or read afresh from
+   the file of its region.  Changes to a memory-mapped page belong to
+   the file, so they are written back first. */
+void
+supplemental_discard_page (struct thread *t, struct page *page)
+{
+  /* Pages locked by mlock() stay resident until unlocked. */
+  if (page->locked)
+    return;
+
+  frame_wait_page (page);
+
+  if (page->page_status & PAGE_ZERO_SHARED)
+    pagedir_clear_page (t->pagedir, page->vaddr);
+
+  frame_allocator_write_back_user_page (page);
+
+  if (page->swap_slot != SWAP_SLOT_NONE)
+    swap_free (page->swap_slot);
+
+  /* A page of a region is set up again from the region on its next
+     fault. */
+  if (page->region != NULL)
+    supplemental_remove_page_entry (&t->supplemental_page_table, page->vaddr);
+  else
+    {
+      page->page_status = PAGE_ZERO;
+      page->swap_slot = SWAP_SLOT_NONE;
+    }
+}
+
+/* Gives the running process, which PARENT is forking, a copy of
+   every page of PARENT, which must be blocked meanwhile.  The regions
+   of the running process must already be copies of PARENT's.
+   Returns false if memory is short, in which case the pages copied so
+   far are freed with the rest of the process. */
+bool
+supplemental_fork (struct thread *parent)
+{
+  struct thread *cur = thread_current ();
+  struct hash_iterator i;
+  bool success = true;
 
-  return p->writable; 
+  lock_acquire (&parent->supplemental_page_table_lock);
+  hash_first (&i, &parent->supplemental_page_table);
+  while (success && hash_next (&i))
+    success = supplemental_fork_page (cur,
+                                      hash_entry (hash_cur (&i), struct page,
+                                                  hash_elem));
+  lock_release (&parent->supplemental_page_table_lock);
+
+  return success;
+}
+
+/* Copies PAGE of a forking process into the running process T.  A
+   resident page shares its frame copy-on-write.  A swapped-out page
+   is read into a frame of T's own, since a swap slot belongs to a
+   single page.  Anything else is left to be set up again on T's first
+   fault on it, as if it had never been touched; a memory-mapped page
+   has been written back to its file by then, so T sees PAGE's data. */
+static bool
+supplemental_fork_page (struct thread *t, struct page *page)
+{
+  struct page *child = malloc (sizeof (struct page));
+  enum page_status status;
+
+  if (child == NULL)
+    return false;
+
+  child->vaddr = page->vaddr;
+  child->region = page->region != NULL
+                  ? region_find (&t->regions, page->vaddr) : NULL;
+  child->swap_slot = SWAP_SLOT_NONE;
+  child->writable = page->writable;
+  child->owner = NULL;
+  child->frame = NULL;
+  child->locked = false;
+
+  if (frame_share_page (page, child))
+    {
+      supplemental_insert_page_info (&t->supplemental_page_table, child);
+      return true;
+    }
+
+  /* Not shared, so not in the middle of being evicted either: the
+     status is final. */
+  status = page->page_status;
+  if (status & PAGE_SWAP)
+    {
+      /* As on a fault, the page is only marked as in memory once it
+         has been read, so that its frame cannot be evicted or merged
+         while it is being filled. */
+      child->page_status = status & ~(PAGE_IN_MEMORY | PAGE_SWAP);
+      void *kernel_vaddr = frame_allocator_get_user_page (child, 0,
+                                                          child->writable);
+      if (kernel_vaddr == NULL)
+        {
+          free (child);
+          return false;
+        }
+      swap_load (page->swap_slot, kernel_vaddr);
+      child->page_status |= PAGE_IN_MEMORY;
+      supplemental_insert_page_info (&t->supplemental_page_table, child);
+      return true;
+    }
+
+  /* Only a frame of a file that every process reads the same may be
+     left behind; the sharing above can fail for others if memory is
+     short. */
+  if ((status & PAGE_IN_MEMORY) && !(status & PAGE_MEMORY_MAPPED)
+      && (page->region == NULL || page->writable))
+    {
+      free (child);
+      return false;
+    }
+
+  if (child->region != NULL)
+    {
+      free (child);
+      return true;
+    }
+
+  child->page_status = PAGE_ZERO;
+  supplemental_insert_page_info (&t->supplemental_page_table, child);
+  return true;
 }
 
 unsigned
@@ -192,32 +334,26 @@ supplemental_page_table_destroy_func (struct hash_elem *e, void *aux UNUSED)
   struct page *page =  hash_entry (e, struct page, hash_elem);
   // printf ("free\n");
 
-  if (page->page_status & PAGE_IN_MEMORY) {
+  /* The zero page is not ours to free along with the page directory. */
+  if (page->page_status & PAGE_ZERO_SHARED)
+    pagedir_clear_page (thread_current ()->pagedir, page->vaddr);
+
+  /* A page with an owner is mapped to a frame, even if it is still
+     being read in and so not yet marked as in memory, or is being
+     evicted, in which case freeing it waits for that to finish. */
+  if (page->owner != NULL) {
     // printf ("free page in memory: %X\n", page->vaddr);
     if (page->vaddr) 
-      free_user_page   (page->vaddr);
-  }
-
-  if (page->page_status & PAGE_FILESYS) {
-    // printf ("free filesys\n");
-
-    if (page->aux)
-      free(page->aux), page->aux = NULL;
+      free_user_page   (page);
   }
 
-  if (page->page_status & PAGE_MEMORY_MAPPED) {
-    // printf ("free mem_mapped\n");
-      if(page->aux)
-        free (page->aux), page->aux = NULL;
-  }
-  if (page->page_status & PAGE_SWAP) {
+  /* A page keeps its swap slot after being swapped in. */
+  if (page->swap_slot != SWAP_SLOT_NONE) {
     // printf ("free swap\n");
-      if (page->aux) {
-        swap_free (page->aux);
-      }
+    swap_free (page->swap_slot);
   }
 
-
+  frame_unlock_page (page);
   free (page);
 }
 
@@ -26,38 +26,28 @@ enum page_status {
     PAGE_MEMORY_MAPPED  = 1 << 2,
     PAGE_IN_MEMORY = 1 << 3,
     PAGE_ZERO = 1 << 4,
+    PAGE_ZERO_SHARED = 1 << 5,      /* Mapped read-only to the zero frame. */
+    PAGE_MERGED = 1 << 6,           /* Mapped read-only to a frame merged by KSM. */
 };
 
-struct page_filesys_info {
-    struct file *file;
-    size_t offset;
-    size_t length;
-};
-
-struct page_mmap_info {
-    mapid_t mapid;                  /* The mmap() mapid. */
-    size_t offset;                  /* The offset into the file. */
-    size_t length;                  /* The number of bytes of the file stored in this page. */
-};
+struct frame;
+struct region;
 
 struct page {
     struct hash_elem hash_elem;     /* Used to store the frame in the page table. */
     void *vaddr;                    /* The address of the page in user virtual memory. */
-    void *aux;                      /* */
+    struct region *region;          /* The region it belongs to, or NULL. */
+    swap_slot_t swap_slot;          /* The swap slot holding the page, if any. */
     enum page_status page_status;   /* Used to store the page's current status. */
     bool writable;                  /* Stores if a page is writable or not */
+    struct list_elem frame_elem;    /* Element in its frame's reverse map. */
+    struct thread *owner;           /* The thread whose page directory maps it. */
+    struct frame *frame;            /* The frame it is mapped to, or NULL. */
+    bool locked;                    /* Locked in memory by mlock(). */
 };
 
-struct page* supplemental_create_filesys_page_info (void *vaddr,
-                                                    struct page_filesys_info *filesys_info,
-                                                    bool writable);
-struct page* supplemental_create_zero_page_info (void *vaddr);
 struct page* supplemental_create_in_memory_page_info (void *vaddr,
                                                       bool writable);
-struct page* supplemental_create_mmap_page_info (void *vaddr,
-                                                 struct page_mmap_info *mmap_info);
-struct page* supplemental_create_swap_page (void *vaddr,
-                                    struct swap_entry *swap_page);
 
 
 void supplemental_insert_page_info (struct hash *supplemental_page_table,
@@ -71,7 +61,10 @@ void supplemental_mark_page_not_in_memory (struct hash *supplemental_page_table,
 bool supplemental_entry_exists (struct hash *supplemental_page_table,
                                 void *uaddr,
                                 struct page **entry);
-bool supplemental_is_page_writable (struct hash *supplemental_page_table, void *uaddr);
+struct page *supplemental_lookup_page (struct thread *t, void *uaddr);
+bool supplemental_is_mapped (struct thread *t, void *uaddr, bool *writable);
+void supplemental_discard_page (struct thread *t, struct page *page);
+bool supplemental_fork (struct thread *parent);
 void supplemental_remove_page_entry (struct hash *supplemental_page_table, void *uaddr); 
 
 
@@ -0,0 +1,163 @@
+#include "vm/region.h"
+
+#include <debug.h>
+#include <round.h>
+#include "threads/malloc.h"
+#include "threads/vaddr.h"
+
+static bool region_less (const struct list_elem *a,
+                         const struct list_elem *b, void *aux);
+
+/* Creates a region of SIZE bytes at START, which must be page
+   aligned, and adds it to REGIONS.  Its first READ_BYTES bytes come
+   from FILE starting at OFFSET; the rest are zeros.  Returns the new
+   region, or NULL if memory is short. */
+struct region *
+region_create (struct list *regions, void *start, size_t size,
+               enum page_status type, struct file *file,
+               off_t offset, size_t read_bytes, bool writable)
+{
+  struct region *r;
+
+  ASSERT (pg_ofs (start) == 0);
+  ASSERT (read_bytes <= ROUND_UP (size, PGSIZE));
+
+  r = malloc (sizeof *r);
+  if (r == NULL)
+    return NULL;
+
+  r->start = start;
+  r->end = (uint8_t *) start + ROUND_UP (size, PGSIZE);
+  r->type = type;
+  r->file = file;
+  r->offset = offset;
+  r->read_bytes = read_bytes;
+  r->writable = writable;
+  r->advice = MADV_NORMAL;
+  list_insert_ordered (regions, &r->elem, region_less, NULL);
+
+  return r;
+}
+
+/* Adds to REGIONS a copy of R, from another process, backed by FILE
+   instead of R's own file.  Returns the copy, or NULL if memory is
+   short. */
+struct region *
+region_copy (struct list *regions, const struct region *r, struct file *file)
+{
+  struct region *copy = region_create (regions, r->start,
+                                       (uint8_t *) r->end - (uint8_t *) r->start,
+                                       r->type, file, r->offset,
+                                       r->read_bytes, r->writable);
+  if (copy != NULL)
+    copy->advice = r->advice;
+  return copy;
+}
+
+/* Removes R from its list and frees it.  The pages of R must have
+   been removed from the supplemental page table already. */
+void
+region_destroy (struct region *r)
+{
+  list_remove (&r->elem);
+  free (r);
+}
+
+/* Frees every region in REGIONS. */
+void
+region_destroy_all (struct list *regions)
+{
+  while (!list_empty (regions))
+    region_destroy (list_entry (list_front (regions), struct region, elem));
+}
+
+/* Returns the region of REGIONS containing VADDR, or NULL. */
+struct region *
+region_find (struct list *regions, const void *vaddr)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (regions); e != list_end (regions); e = list_next (e))
+    {
+      struct region *r = list_entry (e, struct region, elem);
+
+      if (vaddr < r->start)
+        break;
+      if (vaddr < r->end)
+        return r;
+    }
+
+  return NULL;
+}
+
+/* Returns true if any region of REGIONS overlaps the SIZE bytes
+   starting at START. */
+bool
+region_overlaps (struct list *regions, const void *start, size_t size)
+{
+  const uint8_t *end = (const uint8_t *) start + size;
+  struct list_elem *e;
+
+  for (e = list_begin (regions); e != list_end (regions); e = list_next (e))
+    {
+      struct region *r = list_entry (e, struct region, elem);
+
+      if ((const void *) end <= r->start)
+        break;
+      if (start < r->end)
+        return true;
+    }
+
+  return false;
+}
+
+/* Records ADVICE as the access pattern of every region of REGIONS
+   overlapping the SIZE bytes starting at START.  Regions are not
+   split, so the advice covers the whole of each region touched. */
+void
+region_advise (struct list *regions, const void *start, size_t size,
+               int advice)
+{
+  const uint8_t *end = (const uint8_t *) start + size;
+  struct list_elem *e;
+
+  for (e = list_begin (regions); e != list_end (regions); e = list_next (e))
+    {
+      struct region *r = list_entry (e, struct region, elem);
+
+      if ((const void *) end <= r->start)
+        break;
+      if (start < r->end)
+        r->advice = advice;
+    }
+}
+
+/* Stores the offset in R's file of the page at VADDR in *OFFSET, and
+   the number of bytes of file data the page holds in *LENGTH.  The
+   length is 0 for pages entirely past the file data. */
+void
+region_page_location (const struct region *r, const void *vaddr,
+                      off_t *offset, size_t *length)
+{
+  size_t ofs = (const uint8_t *) pg_round_down (vaddr)
+               - (const uint8_t *) r->start;
+
+  ASSERT (vaddr >= r->start && vaddr < r->end);
+
+  *offset = r->offset + ofs;
+  if (ofs >= r->read_bytes)
+    *length = 0;
+  else
+    *length = r->read_bytes - ofs < PGSIZE ? r->read_bytes - ofs : PGSIZE;
+}
+
+/* Orders regions by start address. */
+static bool
+region_less (const struct list_elem *a, const struct list_elem *b,
+             void *aux UNUSED)
+{
+  const struct region *region_a = list_entry (a, struct region, elem);
+  const struct region *region_b = list_entry (b, struct region, elem);
+
+  return region_a->start < region_b->start;
+}
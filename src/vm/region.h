@@ -0,0 +1,47 @@
+#ifndef VM_REGION_H
+#define VM_REGION_H
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "filesys/off_t.h"
+#include "vm/page.h"
+
+/* A file-backed range of a process's address space: a segment of
+   the executable, or a memory-mapped file.  A region describes every
+   page in it at once, so setting one up costs the same whatever its
+   size.  A page of a region gets a struct page of its own only when
+   it is first faulted in; see supplemental_lookup_page().
+
+   The regions of a process are kept on a list sorted by address.  A
+   process has only a handful of them, so a linear search is
+   enough. */
+struct region {
+	struct list_elem elem;			/* Element in the thread's region list.  */
+	void *start;					/* First page of the region.             */
+	void *end;						/* Page-aligned end of the region.       */
+	enum page_status type;			/* PAGE_FILESYS or PAGE_MEMORY_MAPPED.   */
+	struct file *file;				/* The file backing the region.          */
+	off_t offset;					/* Offset of START within the file.      */
+	size_t read_bytes;				/* Bytes of file data from START; the
+									   rest of the region is zero-filled.    */
+	bool writable;					/* Whether its pages may be written.     */
+	int advice;						/* MADV_NORMAL, MADV_RANDOM or
+									   MADV_SEQUENTIAL, from madvise().      */
+};
+
+struct region *region_create (struct list *regions, void *start, size_t size,
+                              enum page_status type, struct file *file,
+                              off_t offset, size_t read_bytes, bool writable);
+struct region *region_copy (struct list *regions, const struct region *r,
+                            struct file *file);
+void region_destroy (struct region *r);
+void region_destroy_all (struct list *regions);
+
+struct region *region_find (struct list *regions, const void *vaddr);
+bool region_overlaps (struct list *regions, const void *start, size_t size);
+void region_advise (struct list *regions, const void *start, size_t size,
+                    int advice);
+void region_page_location (const struct region *r, const void *vaddr,
+                           off_t *offset, size_t *length);
+
+#endif /* vm/region.h */
@@ -1,136 +1,180 @@
 #include "vm/swap.h"
-#include "vm/frame.h"
 
+#include <bitmap.h>
+#include <debug.h>
+#include <stdio.h>
 #include "devices/block.h" // For swap block
 #include "threads/synch.h" // For locks
 #include "threads/vaddr.h" // For PGSIZE
+#include "vm/zswap.h" // For the compressed cache in front of the partition
 
 /* The number of sectors in a page. */
-#define PAGE_NUM_SECTORS PGSIZE / BLOCK_SECTOR_SIZE 
+#define PAGE_NUM_SECTORS (PGSIZE / BLOCK_SECTOR_SIZE)
 
 /* Swap Block Pointer - points to the block dedicated to swap on the filesystem */
 static struct block *swap_block; 
 
-/* Size of the Swap Block in bytes */
-static size_t swap_size;
-
 /* Number of pages that will fit into the Swap block */
 static size_t max_pages;         
 
-/* Global lock to stop concurrent access of the swap table. */
+/* Protects the swap slot map and cursor.  It is not held during
+   disk transfers. */
 static struct lock swap_lock;        
 
-/* The Swap Table Array */
-static struct swap_entry *swap_table;
+/* One bit per swap slot, set if the slot is in use. */
+static struct bitmap *swap_slots;
+
+/* Next-fit cursor: the search for a free slot starts just after the
+   most recently allocated one, so a nearly full swap partition does
+   not rescan its full prefix on every allocation. */
+static size_t swap_cursor;
 
-/* The Size of the Swap Table in bytes */
-static size_t swap_table_size;
+/* Swap-in statistics, split by where the page came from.  Times are
+   in CPU cycles, as read from the time-stamp counter. */
+static long long ram_load_cnt, ram_load_cycles;
+static long long disk_load_cnt, disk_load_cycles;
 
+/* Number of slots allocated next to the previous page's slot. */
+static long long cluster_cnt;
 
-struct swap_entry *find_first_free_entry(); // Utility Function for finding a free swap page
+static block_sector_t swap_slot_sector (swap_slot_t slot);
+static uint64_t swap_cycles (void);
 
-void swap_init() {
+// Initialise the Swap System, with a compressed cache of ZSWAP_PAGES
+// kernel pages in front of the partition (see zswap_init()).
+void swap_init(size_t zswap_pages) {
   // Get the swap block from the filesystem
-  int i;
   swap_block = block_get_role (BLOCK_SWAP);
   if (swap_block == NULL) {
     PANIC ("Swap Initialisation Failure: No Swap Data Partition");
   }
   // block_size returns the number of sectors in a block
-  swap_size = block_size (swap_block) * BLOCK_SECTOR_SIZE; 
-  max_pages = swap_size / PGSIZE;
-  // Allocate the swap table
-  swap_table_size = max_pages * sizeof(struct swap_entry);
-  swap_table = malloc(swap_table_size);
-  if (!swap_table) {
+  max_pages = block_size (swap_block) / PAGE_NUM_SECTORS;
+
+  // Allocate the slot map, with every slot free
+  swap_slots = bitmap_create (max_pages);
+  if (!swap_slots) {
     PANIC ("Swap Initialisation Failure: Failed to initialise the Swap Table");
   }
+  swap_cursor = 0;
   
   // Initialise the Swap lock
   lock_init(&swap_lock);
 
-  // Initialise the Swap Table
-  for (i = 0; i < max_pages; i++){
-    swap_table[i].block = i*PAGE_NUM_SECTORS;
-    swap_table[i].in_use = false;
-  }
+  zswap_init (zswap_pages, max_pages);
 }
 
 // Called at the end of the OS lifetime, to cleanup the memory used
-void swap_destroy() {
-  free(swap_table);
+void swap_destroy(void) {
+  bitmap_destroy(swap_slots);
 } 
 
-// Allocate a page in Swap, returning the page address.
-struct swap_entry *swap_alloc() {
+// Allocate a page-sized slot in Swap, starting from the cursor and
+// wrapping around to the start of the partition.
+swap_slot_t swap_alloc(void) {
   lock_acquire(&swap_lock);
-  struct swap_entry* entry = find_first_free_entry();
+  size_t slot = bitmap_scan_bit (swap_slots, swap_cursor, false);
+  if (slot == BITMAP_ERROR)
+    slot = bitmap_scan_bit (swap_slots, 0, false);
 
-  if (!entry)
+  if (slot == BITMAP_ERROR)
     PANIC("No more SWAP available");
 
-  entry->in_use = true;
+  bitmap_mark (swap_slots, slot);
+  swap_cursor = slot + 1 < max_pages ? slot + 1 : 0;
   lock_release(&swap_lock);
-  return entry;
-
+  return slot;
 }
 
-// Returns the first free entry, or NULL if none available.
-struct swap_entry *find_first_free_entry() {
-  struct swap_entry * entry;
-  for (entry = swap_table; entry < swap_table + swap_table_size; entry++) {
-    if (!entry -> in_use)
-      return entry;
-  }
-  return NULL;
-}
-// Free a given page in Swap
-void  swap_free(struct swap_entry * swap_location) {
+// Allocate a slot in Swap, taking HINT if it is free.  Pages
+// evicted one after another from neighbouring virtual addresses
+// pass the slot after their predecessor's, so that they end up in
+// one contiguous cluster that can be read back as a stream.
+swap_slot_t swap_alloc_near(swap_slot_t hint) {
   lock_acquire(&swap_lock);
-  swap_location->in_use = false;
+  if (hint < max_pages && !bitmap_test (swap_slots, hint)) {
+    bitmap_mark (swap_slots, hint);
+    swap_cursor = hint + 1 < max_pages ? hint + 1 : 0;
+    cluster_cnt++;
+    lock_release(&swap_lock);
+    return hint;
+  }
   lock_release(&swap_lock);
+
+  return swap_alloc();
 }
 
+// Free a given slot in Swap
+void  swap_free(swap_slot_t slot) {
+  zswap_invalidate (slot);
 
-// Save a page to Swap
-void  swap_save(struct swap_entry * swap_location, void *physical_address) {
   lock_acquire(&swap_lock);
-  // printf("---Save Swap Location: %X Thread: %i\n", physical_address, thread_current()->tid);
-  ASSERT(swap_location->in_use);
-  void *originPtr = physical_address;
-  block_sector_t block_sector;
-  for( block_sector = swap_location->block;
-       block_sector < swap_location->block + PAGE_NUM_SECTORS;
-       block_sector ++
-       )
-    {
-      block_write(swap_block,      // To Block
-                  block_sector,    // With Sector
-                  physical_address // From Page
-                  );
-      physical_address += BLOCK_SECTOR_SIZE;
-    }
+  ASSERT(bitmap_test (swap_slots, slot));
+  bitmap_reset (swap_slots, slot);
   lock_release(&swap_lock);
+}
+
+// Returns the first sector of SLOT on the swap block.
+static block_sector_t
+swap_slot_sector (swap_slot_t slot)
+{
+  ASSERT (slot < max_pages);
+  return slot * PAGE_NUM_SECTORS;
+}
+
+// Save a page to Swap: compressed in memory if it fits there,
+// otherwise on the partition.
+void  swap_save(swap_slot_t slot, const void *kernel_vaddr) {
+  ASSERT(bitmap_test (swap_slots, slot));
+
+  /* SLOT may hold an older copy of the page, which is now stale. */
+  zswap_invalidate (slot);
+  if (!zswap_store (slot, kernel_vaddr))
+    swap_writeback (slot, kernel_vaddr);
 } 
 
-// Load a page from swap, and return it's physical address, or NULL if there are no more pages available.
- void *swap_load(struct swap_entry * swap_location, struct page *page, void *kernel_vaddr) {
-  lock_acquire(&swap_lock);
-  ASSERT(swap_location->in_use);
-  // printf("-----Load Swap Location: %X Thread: %i\n", kernel_vaddr, thread_current()->tid);
-  void *page_sector = kernel_vaddr;
-  block_sector_t block_sector;
-  for( block_sector = swap_location->block;
-       block_sector < swap_location->block + PAGE_NUM_SECTORS;
-       block_sector ++
-       )
-    {
-      block_read (swap_block,      // From Block
-                  block_sector,    // With Sector
-                  page_sector      // To Page Sector
-                  );
-      page_sector +=  BLOCK_SECTOR_SIZE;
-    }
-  lock_release(&swap_lock);
-  return kernel_vaddr;
+// Write a page to SLOT on the Swap partition.  The caller owns SLOT,
+// so the transfer needs no lock of ours; the block layer serialises
+// access to the disk.
+void  swap_writeback(swap_slot_t slot, const void *kernel_vaddr) {
+  ASSERT(bitmap_test (swap_slots, slot));
+  block_write_multi (swap_block, swap_slot_sector (slot), PAGE_NUM_SECTORS,
+                     kernel_vaddr);
+}
+
+// Load a page from Swap into the frame at KERNEL_VADDR.
+void swap_load(swap_slot_t slot, void *kernel_vaddr) {
+  uint64_t start = swap_cycles ();
+
+  ASSERT(bitmap_test (swap_slots, slot));
+  if (zswap_load (slot, kernel_vaddr)) {
+    ram_load_cnt++;
+    ram_load_cycles += swap_cycles () - start;
+    return;
+  }
+
+  block_read_multi (swap_block, swap_slot_sector (slot), PAGE_NUM_SECTORS,
+                    kernel_vaddr);
+  disk_load_cnt++;
+  disk_load_cycles += swap_cycles () - start;
+}
+
+// Print how many pages were swapped in from memory and from disk,
+// and how long each took on average.
+void swap_print_stats(void) {
+  printf ("Swap: %lld loads from memory, avg %lld cycles\n", ram_load_cnt,
+          ram_load_cnt > 0 ? ram_load_cycles / ram_load_cnt : 0);
+  printf ("Swap: %lld loads from disk, avg %lld cycles\n", disk_load_cnt,
+          disk_load_cnt > 0 ? disk_load_cycles / disk_load_cnt : 0);
+  printf ("Swap: %lld slots allocated in clusters\n", cluster_cnt);
+  zswap_print_stats ();
+}
+
+// Returns the CPU time-stamp counter.
+static uint64_t
+swap_cycles (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
 } 
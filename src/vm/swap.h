@@ -1,23 +1,23 @@
 #ifndef VM_SWAP_H
 #define VM_SWAP_H
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include "devices/block.h"
-#include "vm/page.h"
 
+/* Index of a page-sized slot in the swap partition. */
+typedef size_t swap_slot_t;
+#define SWAP_SLOT_NONE SIZE_MAX      /* Denotes a page with no swap slot. */
 
-/* Stores if a block is in use or not, and the location of that block */
-struct swap_entry {
-	block_sector_t block;
-	bool in_use;
-};
 
+void swap_init(size_t zswap_pages); // Called to initialise the Swap System by init.c
+void swap_destroy(void); // Called at the end of the OS lifetime, to cleanup the memory used
+swap_slot_t swap_alloc(void); // Allocate a page-sized slot in Swap.
+swap_slot_t swap_alloc_near(swap_slot_t hint); // Allocate a slot, preferably HINT.
+void  swap_free(swap_slot_t slot); // Free a given slot in Swap
+void  swap_save(swap_slot_t slot, const void *kernel_vaddr); // Save a page to Swap
+void  swap_load(swap_slot_t slot, void *kernel_vaddr); // Load a page from Swap
+void  swap_writeback(swap_slot_t slot, const void *kernel_vaddr); // Write a page to the Swap partition
+void  swap_print_stats(void); // Print Swap statistics
 
-void swap_init(); // Called to initialise the Swap System by init.c
-void swap_destroy(); // Called at the end of the OS lifetime, to cleanup the memory used
-struct swap_entry *swap_alloc(); // Allocate a page in Swap, returning the page address.
-void  swap_free(struct swap_entry * swap_location); // Free a given page in Swap
-void  swap_save(struct swap_entry * swap_location, void *physical_address); // Save a page to Swap
- // Load a page from swap, and return it's physical address, or NULL if there are no more pages available.
-void *swap_load(struct swap_entry * swap_location, struct page *page, void * kernel_vaddr);
-
-#endif VM_SWAP_H
\ No newline at end of file
+#endif /* vm/swap.h */
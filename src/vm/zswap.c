@@ -0,0 +1,475 @@
+#include "vm/zswap.h"
+
+#include <bitmap.h>
+#include <debug.h>
+#include <list.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <round.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* A compressed swap cache in front of the swap partition.
+
+   Pages being swapped out are compressed into a pool of kernel
+   pages, so that swapping them back in costs a decompression rather
+   than a disk read.  A page whose compressed form would not save at
+   least a quarter of its size goes straight to disk.  When the pool
+   is full, the least recently stored pages are decompressed and
+   written to their swap slots on disk to make room.
+
+   Every page held here still owns its swap slot, which is where it
+   is written if it is pushed out of the pool, so the pool never
+   changes which slots are in use.
+
+   The compressor is a byte-oriented LZ77 in the style of LZ4: a
+   sequence of (literal run, back-reference) pairs, each introduced
+   by a token byte holding both lengths, with longer lengths spilled
+   into following bytes. */
+
+/* Bytes per pool allocation unit. */
+#define ZSWAP_CHUNK_SIZE 64
+
+/* Pages that do not compress to this size or less are not kept. */
+#define ZSWAP_MAX_LENGTH (PGSIZE * 3 / 4)
+
+/* Compressor parameters. */
+#define LZ_MIN_MATCH 4                /* Shortest back-reference. */
+#define LZ_HASH_BITS 10               /* Log2 of the match table size. */
+
+/* A page held in the pool. */
+struct zswap_entry
+  {
+    struct list_elem lru_elem;        /* Element in zswap_lru. */
+    size_t chunk;                     /* First pool chunk used. */
+    size_t length;                    /* Compressed bytes, 0 if none. */
+    bool writeback;                   /* Being written to disk. */
+  };
+
+/* Protects everything below, including the scratch buffers.  It is
+   not held while a page is written back to disk: the page leaves the
+   pool first and its entry is marked as in writeback, so that loads
+   and invalidations of its slot wait for the write to finish. */
+static struct lock zswap_lock;
+
+/* Signalled, with zswap_lock, whenever a writeback finishes. */
+static struct condition zswap_written;
+
+static uint8_t *pool;                 /* Compressed data. */
+static size_t pool_chunks;            /* Number of chunks in POOL. */
+static struct bitmap *pool_map;       /* One bit per chunk, set if used. */
+
+static struct zswap_entry *entries;   /* One per swap slot. */
+static size_t entry_cnt;
+
+/* Entries holding data, least recently stored first. */
+static struct list zswap_lru;
+
+/* Scratch space for compressing. */
+static uint8_t compress_buffer[ZSWAP_MAX_LENGTH];
+static uint16_t lz_table[1 << LZ_HASH_BITS];
+
+/* Statistics. */
+static long long store_cnt;           /* # of pages stored. */
+static long long reject_cnt;          /* # of incompressible pages. */
+static long long load_cnt;            /* # of pages loaded from the pool. */
+static long long writeback_cnt;       /* # of pages pushed out to disk. */
+static long long stored_bytes;        /* Compressed size of stored pages. */
+
+static bool zswap_enabled (void);
+static void zswap_drop (struct zswap_entry *e);
+static void zswap_wait (struct zswap_entry *e);
+static bool zswap_writeback_lru (void);
+static size_t lz_compress (const uint8_t *src, uint8_t *dst, size_t dst_max);
+static bool lz_decompress (const uint8_t *src, size_t length, uint8_t *dst);
+
+/* Sets up a pool of POOL_PAGES kernel pages for compressed pages,
+   covering swap slots 0...SLOT_CNT-1.  A POOL_PAGES of
+   ZSWAP_POOL_DEFAULT picks a size scaled to the user pool; 0, or a
+   pool that cannot be allocated, disables the cache. */
+void
+zswap_init (size_t pool_pages, size_t slot_cnt)
+{
+  lock_init (&zswap_lock);
+  cond_init (&zswap_written);
+  list_init (&zswap_lru);
+
+  if (pool_pages == ZSWAP_POOL_DEFAULT)
+    pool_pages = palloc_user_pool_size () / 8;
+  if (pool_pages == 0 || slot_cnt == 0)
+    return;
+
+  pool = palloc_get_multiple (0, pool_pages);
+  entries = calloc (slot_cnt, sizeof *entries);
+  pool_chunks = pool_pages * (PGSIZE / ZSWAP_CHUNK_SIZE);
+  pool_map = bitmap_create (pool_chunks);
+  if (pool == NULL || entries == NULL || pool_map == NULL)
+    {
+      printf ("zswap: cannot allocate a %zu page pool, disabled\n",
+              pool_pages);
+      if (pool != NULL)
+        palloc_free_multiple (pool, pool_pages);
+      free (entries);
+      if (pool_map != NULL)
+        bitmap_destroy (pool_map);
+      pool = NULL;
+      return;
+    }
+  entry_cnt = slot_cnt;
+}
+
+/* Returns true if the pool was set up. */
+static bool
+zswap_enabled (void)
+{
+  return pool != NULL;
+}
+
+/* Tries to keep the page at KERNEL_VADDR, which is being saved to
+   SLOT, in the pool.  Returns true if it did, false if the page must
+   be written to disk instead. */
+bool
+zswap_store (swap_slot_t slot, const void *kernel_vaddr)
+{
+  struct zswap_entry *e;
+  size_t length, chunk_cnt, chunk;
+
+  if (!zswap_enabled ())
+    return false;
+  ASSERT (slot < entry_cnt);
+
+  lock_acquire (&zswap_lock);
+  e = &entries[slot];
+  ASSERT (e->length == 0 && !e->writeback);
+
+  /* Make room by writing the coldest pages back to disk.  The lock is
+     released for each write, and another store may use the scratch
+     buffer meanwhile, so the page is compressed again after it. */
+  for (;;)
+    {
+      length = lz_compress (kernel_vaddr, compress_buffer, ZSWAP_MAX_LENGTH);
+      if (length == 0)
+        {
+          reject_cnt++;
+          lock_release (&zswap_lock);
+          return false;
+        }
+
+      chunk_cnt = DIV_ROUND_UP (length, ZSWAP_CHUNK_SIZE);
+      chunk = bitmap_scan_and_flip (pool_map, 0, chunk_cnt, false);
+      if (chunk != BITMAP_ERROR)
+        break;
+      if (!zswap_writeback_lru ())
+        {
+          lock_release (&zswap_lock);
+          return false;
+        }
+    }
+
+  memcpy (pool + chunk * ZSWAP_CHUNK_SIZE, compress_buffer, length);
+  e->chunk = chunk;
+  e->length = length;
+  list_push_back (&zswap_lru, &e->lru_elem);
+
+  store_cnt++;
+  stored_bytes += length;
+  lock_release (&zswap_lock);
+  return true;
+}
+
+/* Loads the page saved to SLOT into KERNEL_VADDR, if it is in the
+   pool, and returns true.  The pool keeps its copy until the slot
+   is freed.  Returns false if the page is on disk, after waiting for
+   it to get there if it is being written back. */
+bool
+zswap_load (swap_slot_t slot, void *kernel_vaddr)
+{
+  struct zswap_entry *e;
+  bool ok;
+
+  if (!zswap_enabled ())
+    return false;
+  ASSERT (slot < entry_cnt);
+
+  lock_acquire (&zswap_lock);
+  e = &entries[slot];
+  zswap_wait (e);
+  if (e->length == 0)
+    {
+      lock_release (&zswap_lock);
+      return false;
+    }
+
+  ok = lz_decompress (pool + e->chunk * ZSWAP_CHUNK_SIZE, e->length,
+                      kernel_vaddr);
+  if (!ok)
+    PANIC ("zswap: slot %zu is corrupt", slot);
+  load_cnt++;
+  lock_release (&zswap_lock);
+  return true;
+}
+
+/* Forgets any copy of SLOT held in the pool, because the slot is
+   being freed or rewritten.  If the page is being written back, waits
+   for that to finish, so that the write cannot land after the slot's
+   next one. */
+void
+zswap_invalidate (swap_slot_t slot)
+{
+  if (!zswap_enabled ())
+    return;
+  ASSERT (slot < entry_cnt);
+
+  lock_acquire (&zswap_lock);
+  zswap_wait (&entries[slot]);
+  if (entries[slot].length != 0)
+    zswap_drop (&entries[slot]);
+  lock_release (&zswap_lock);
+}
+
+/* Prints pool statistics. */
+void
+zswap_print_stats (void)
+{
+  if (!zswap_enabled ())
+    return;
+
+  printf ("Zswap: %lld pages stored, %lld incompressible, "
+          "%lld loaded, %lld written back\n",
+          store_cnt, reject_cnt, load_cnt, writeback_cnt);
+  if (store_cnt > 0)
+    printf ("Zswap: compressed to %lld%% of original size on average\n",
+            stored_bytes * 100 / (store_cnt * PGSIZE));
+}
+
+/* Releases E's pool space.  Must be called with zswap_lock held. */
+static void
+zswap_drop (struct zswap_entry *e)
+{
+  list_remove (&e->lru_elem);
+  bitmap_set_multiple (pool_map, e->chunk,
+                       DIV_ROUND_UP (e->length, ZSWAP_CHUNK_SIZE), false);
+  e->length = 0;
+}
+
+/* Waits until E is not being written back.  Must be called with
+   zswap_lock held. */
+static void
+zswap_wait (struct zswap_entry *e)
+{
+  while (e->writeback)
+    cond_wait (&zswap_written, &zswap_lock);
+}
+
+/* Writes the least recently stored page back to its swap slot and
+   drops it from the pool.  Returns false if the pool is empty, or if
+   no page can be had to decompress it into.  Must be called with
+   zswap_lock held.  The lock is released during the write, by which
+   time the page's pool space is already free. */
+static bool
+zswap_writeback_lru (void)
+{
+  struct zswap_entry *e;
+  swap_slot_t slot;
+  uint8_t *buffer;
+
+  if (list_empty (&zswap_lru))
+    return false;
+  buffer = palloc_get_page (0);
+  if (buffer == NULL)
+    return false;
+
+  e = list_entry (list_front (&zswap_lru), struct zswap_entry, lru_elem);
+  slot = e - entries;
+  if (!lz_decompress (pool + e->chunk * ZSWAP_CHUNK_SIZE, e->length,
+                      buffer))
+    PANIC ("zswap: slot %zu is corrupt", slot);
+  zswap_drop (e);
+  e->writeback = true;
+
+  lock_release (&zswap_lock);
+  swap_writeback (slot, buffer);
+  lock_acquire (&zswap_lock);
+
+  e->writeback = false;
+  cond_broadcast (&zswap_written, &zswap_lock);
+  palloc_free_page (buffer);
+
+  writeback_cnt++;
+  return true;
+}
+
+/* Returns the 4 bytes at P. */
+static inline uint32_t
+lz_read32 (const uint8_t *p)
+{
+  uint32_t x;
+  memcpy (&x, p, sizeof x);
+  return x;
+}
+
+/* Returns the match table index for the 4 bytes SEQ. */
+static inline size_t
+lz_hash (uint32_t seq)
+{
+  return (seq * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/* Appends LENGTH - the part that fits in a token nibble to *OP, as a
+   run of 255s and a final remainder byte.  Returns false if that
+   would pass OP_END. */
+static bool
+lz_put_length (uint8_t **op, uint8_t *op_end, size_t length)
+{
+  for (; length >= 255; length -= 255)
+    {
+      if (*op >= op_end)
+        return false;
+      *(*op)++ = 255;
+    }
+  if (*op >= op_end)
+    return false;
+  *(*op)++ = length;
+  return true;
+}
+
+/* Appends a sequence to *OP: LIT_LEN literal bytes from LIT, then,
+   if MATCH_LEN is nonzero, a back-reference of MATCH_LEN bytes at
+   distance OFFSET.  Returns false if it does not fit before OP_END. */
+static bool
+lz_put_sequence (uint8_t **op, uint8_t *op_end, const uint8_t *lit,
+                 size_t lit_len, size_t offset, size_t match_len)
+{
+  size_t match_code = match_len > 0 ? match_len - LZ_MIN_MATCH : 0;
+  uint8_t *token;
+
+  if (*op >= op_end)
+    return false;
+  token = (*op)++;
+  *token = (lit_len < 15 ? lit_len : 15) << 4;
+  if (lit_len >= 15 && !lz_put_length (op, op_end, lit_len - 15))
+    return false;
+  if ((size_t) (op_end - *op) < lit_len)
+    return false;
+  memcpy (*op, lit, lit_len);
+  *op += lit_len;
+
+  if (match_len == 0)
+    return true;
+
+  if (op_end - *op < 2)
+    return false;
+  *(*op)++ = offset & 0xff;
+  *(*op)++ = offset >> 8;
+  *token |= match_code < 15 ? match_code : 15;
+  if (match_code >= 15 && !lz_put_length (op, op_end, match_code - 15))
+    return false;
+  return true;
+}
+
+/* Compresses the page at SRC into DST, which has room for DST_MAX
+   bytes.  Returns the compressed length, or 0 if it does not fit. */
+static size_t
+lz_compress (const uint8_t *src, uint8_t *dst, size_t dst_max)
+{
+  const uint8_t *ip = src, *anchor = src;
+  const uint8_t *end = src + PGSIZE;
+  uint8_t *op = dst, *op_end = dst + dst_max;
+
+  memset (lz_table, 0, sizeof lz_table);
+  while (ip + LZ_MIN_MATCH <= end)
+    {
+      uint32_t seq = lz_read32 (ip);
+      size_t h = lz_hash (seq);
+      const uint8_t *ref = src + lz_table[h];
+      const uint8_t *m, *r;
+
+      lz_table[h] = ip - src;
+      if (ref >= ip || lz_read32 (ref) != seq)
+        {
+          ip++;
+          continue;
+        }
+
+      for (m = ip + LZ_MIN_MATCH, r = ref + LZ_MIN_MATCH; m < end && *m == *r;
+           m++, r++)
+        continue;
+
+      if (!lz_put_sequence (&op, op_end, anchor, ip - anchor, ip - ref,
+                            m - ip))
+        return 0;
+      ip = anchor = m;
+    }
+
+  if (anchor < end
+      && !lz_put_sequence (&op, op_end, anchor, end - anchor, 0, 0))
+    return 0;
+  return op - dst;
+}
+
+/* Decompresses the LENGTH bytes at SRC into the page at DST.
+   Returns false if they do not decode to exactly one page. */
+static bool
+lz_decompress (const uint8_t *src, size_t length, uint8_t *dst)
+{
+  const uint8_t *ip = src, *ip_end = src + length;
+  uint8_t *op = dst, *op_end = dst + PGSIZE;
+
+  while (ip < ip_end)
+    {
+      unsigned token = *ip++;
+      size_t lit_len = token >> 4;
+      size_t match_len = token & 15;
+      size_t offset;
+      const uint8_t *r;
+      uint8_t b;
+
+      if (lit_len == 15)
+        do
+          {
+            if (ip >= ip_end)
+              return false;
+            b = *ip++;
+            lit_len += b;
+          }
+        while (b == 255);
+      if ((size_t) (ip_end - ip) < lit_len || (size_t) (op_end - op) < lit_len)
+        return false;
+      memcpy (op, ip, lit_len);
+      op += lit_len;
+      ip += lit_len;
+
+      /* The last sequence has no back-reference. */
+      if (ip == ip_end)
+        break;
+
+      if (ip_end - ip < 2)
+        return false;
+      offset = ip[0] | (ip[1] << 8);
+      ip += 2;
+      if (match_len == 15)
+        do
+          {
+            if (ip >= ip_end)
+              return false;
+            b = *ip++;
+            match_len += b;
+          }
+        while (b == 255);
+      match_len += LZ_MIN_MATCH;
+
+      if (offset == 0 || offset > (size_t) (op - dst)
+          || (size_t) (op_end - op) < match_len)
+        return false;
+
+      /* Byte by byte, because the source may overlap the
+         destination. */
+      for (r = op - offset; match_len > 0; match_len--)
+        *op++ = *r++;
+    }
+
+  return op == op_end;
+}
@@ -0,0 +1,16 @@
+#ifndef VM_ZSWAP_H
+#define VM_ZSWAP_H
+#include <stdbool.h>
+#include <stddef.h>
+#include "vm/swap.h"
+
+/* Passed to zswap_init() to size the pool from the user pool. */
+#define ZSWAP_POOL_DEFAULT SIZE_MAX
+
+void zswap_init (size_t pool_pages, size_t slot_cnt);
+bool zswap_store (swap_slot_t slot, const void *kernel_vaddr);
+bool zswap_load (swap_slot_t slot, void *kernel_vaddr);
+void zswap_invalidate (swap_slot_t slot);
+void zswap_print_stats (void);
+
+#endif /* vm/zswap.h */